@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * bring-up and teardown shared by the benchmarks linked to the midish
+ * objects: they do what main() does, without the console and the rc
+ * file.
+ */
+
+#include <stdio.h>
+#include "utils.h"
+#include "defs.h"
+#include "ev.h"
+#include "filt.h"
+#include "mididev.h"
+#include "cons.h"
+#include "textio.h"
+#include "state.h"
+#include "sysex.h"
+#include "track.h"
+#include "song.h"
+#include "user.h"
+#include "benchutil.h"
+
+/*
+ * initialize pools and subsystems, as main() does
+ */
+void
+bench_init(void)
+{
+	user_flag_batch = 1;
+	cons_init(NULL, NULL);
+	textio_init();
+	evctl_init();
+	seqev_pool_init(DEFAULT_MAXNSEQEVS);
+	state_pool_init(DEFAULT_MAXNSTATES);
+	chunk_pool_init(DEFAULT_MAXNCHUNKS);
+	sysex_pool_init(DEFAULT_MAXNSYSEXS);
+	seqptr_pool_init(DEFAULT_MAXNSEQPTRS);
+	mididev_listinit();
+}
+
+/*
+ * stop and delete the song, if any, then release everything
+ * bench_init() allocated
+ */
+void
+bench_done(void)
+{
+	if (usong != NULL) {
+		song_stop(usong);
+		song_delete(usong);
+		usong = NULL;
+	}
+	mididev_listdone();
+	seqptr_pool_done();
+	sysex_pool_done();
+	chunk_pool_done();
+	state_pool_done();
+	seqev_pool_done();
+	evctl_done();
+	textio_done();
+	cons_done();
+}
+
+/*
+ * create a song with a filter reversing channels (so every event
+ * matches a rule), attach a loop device as unit 0 and put the song
+ * in idle mode. Return the device, or NULL on failure
+ */
+struct mididev *
+bench_idle(char *name)
+{
+	struct songfilt *f;
+	struct evspec from, to;
+	unsigned ch;
+
+	usong = song_new();
+	f = song_filtnew(usong, name);
+	for (ch = 0; ch <= EV_MAXCH; ch++) {
+		evspec_reset(&from);
+		evspec_reset(&to);
+		from.dev_min = from.dev_max = to.dev_min = to.dev_max = 0;
+		from.ch_min = from.ch_max = ch;
+		to.ch_min = to.ch_max = EV_MAXCH - ch;
+		filt_mapnew(&f->filt, &from, &to);
+	}
+	if (!mididev_attach(0, "loop:", MIDIDEV_MODE_IN | MIDIDEV_MODE_OUT)) {
+		fputs("couldn't attach loop device\n", stderr);
+		return NULL;
+	}
+	song_idle(usong);
+	return mididev_byunit[0];
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * filter benchmark: filters with increasing numbers of rules are
+ * built with filt_mapnew(), as the fmap function does, then random
+ * notes are passed through filt_do(). Rules are keyboard splits on
+ * all channels of all devices, each one routed to another device and
+ * channel, so most notes match a rule.
+ *
+ * For each filter, the number of rules, the time to add them, the
+ * time to compile them (as done when the song enters idle mode) and
+ * the mean time per event are printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+#include "defs.h"
+#include "ev.h"
+#include "filt.h"
+#include "benchutil.h"
+
+#define NEV		1000000		/* events per filter */
+
+unsigned nrules[] = {32, 128, 512, 2048, 8192, 0};
+
+/*
+ * store the i-th rule of a filter with n rules: the note range of
+ * each channel is split in as many parts as needed
+ */
+void
+gen_rule(unsigned i, unsigned n, struct evspec *from, struct evspec *to)
+{
+	unsigned nsplit, width, split, dev, ch;
+
+	nsplit = (n + 255) / 256;
+	width = (EV_MAXCOARSE + 1) / nsplit;
+	dev = i % 16;
+	ch = (i / 16) % 16;
+	split = i / 256;
+
+	evspec_reset(from);
+	from->cmd = EVSPEC_NOTE;
+	from->dev_min = from->dev_max = dev;
+	from->ch_min = from->ch_max = ch;
+	from->v0_min = split * width;
+	from->v0_max = split * width + width - 1;
+	from->v1_min = 0;
+	from->v1_max = EV_MAXCOARSE;
+	*to = *from;
+	to->dev_min = to->dev_max = (dev + 1) % 16;
+	to->ch_min = to->ch_max = 15 - ch;
+}
+
+void
+bench_run(unsigned n, struct ev *evs)
+{
+	struct filt f;
+	struct evspec from, to;
+	struct ev out[FILT_MAXNOUT];
+	unsigned long long t0, t1, t2, t3;
+	unsigned i, nout;
+
+	filt_init(&f);
+	t0 = bench_time();
+	for (i = 0; i < n; i++) {
+		gen_rule(i, n, &from, &to);
+		filt_mapnew(&f, &from, &to);
+	}
+	t1 = bench_time();
+	filt_compile(&f);
+	t2 = bench_time();
+	nout = 0;
+	for (i = 0; i < NEV; i++)
+		nout += filt_do(&f, &evs[i], out);
+	t3 = bench_time();
+	filt_done(&f);
+	printf("%8u %10.2f %10.2f %8llu %8u\n", n,
+	    (t1 - t0) / 1e6, (t2 - t1) / 1e6, (t3 - t2) / NEV, nout);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct ev *evs;
+	unsigned i;
+
+	evs = xmalloc(NEV * sizeof(struct ev), "ev");
+	srandom(1);
+	for (i = 0; i < NEV; i++) {
+		evs[i].cmd = EV_NON;
+		evs[i].dev = random() % 16;
+		evs[i].ch = random() % 16;
+		evs[i].note_num = random() % (EV_MAXCOARSE + 1);
+		evs[i].note_vel = 1 + random() % EV_MAXCOARSE;
+	}
+	printf("%8s %10s %10s %8s %8s\n",
+	    "rules", "setup_ms", "comp_ms", "ns/ev", "out");
+	for (i = 0; nrules[i] != 0; i++)
+		bench_run(nrules[i], evs);
+	xfree(evs);
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * output flush benchmark: a loop device is attached and the song is
+ * put in idle mode, as in latbench. Then a controller flood is fed
+ * to the device input routine in blocks of BLKSIZE bytes, as they
+ * would be returned by read(2), and the number of calls to the write
+ * method of the device is counted. This is done with and without
+ * the low-latency mode. After each block, timeouts are advanced by
+ * the time the block takes on a MIDI cable, so the normalizer
+ * throttles controllers as it would in real time.
+ *
+ * For each mode, the number of messages and writes, the mean time to
+ * process a message and the number of writes per second of input
+ * are printed. The latter is the number of write(2) system calls
+ * per second during a flood on a MIDI cable.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "defs.h"
+#include "ev.h"
+#include "mididev.h"
+#include "norm.h"
+#include "timo.h"
+#include "benchutil.h"
+
+#define NMSG		300000		/* messages per run */
+#define BLKSIZE		64		/* bytes per read */
+#define BLKTIME		(BLKSIZE * 320 * 24)	/* 24th of us at 31250 bit/s */
+
+struct devops count_ops;
+unsigned long long nwrites;
+
+unsigned
+count_write(struct mididev *dev, unsigned char *buf, unsigned count)
+{
+	nwrites++;
+	return loop_ops.write(dev, buf, count);
+}
+
+/*
+ * send volume controllers on all channels, as a fader box would
+ */
+void
+bench_run(struct mididev *dev, unsigned lowlat)
+{
+	unsigned char *data;
+	unsigned long long t0, t1;
+	unsigned i, n, len;
+	double secs;
+
+	len = 3 * NMSG;
+	data = xmalloc(len, "flushbench");
+	for (i = 0; i < NMSG; i++) {
+		data[3 * i] = 0xb0 | (i & 0xf);
+		data[3 * i + 1] = 7;
+		data[3 * i + 2] = (i >> 4) & 0x7f;
+	}
+	norm_lowlat = lowlat;
+	nwrites = 0;
+	t0 = bench_time();
+	for (i = 0; i < len; i += n) {
+		n = len - i;
+		if (n > BLKSIZE)
+			n = BLKSIZE;
+		mididev_inputcb(dev, data + i, n);
+		timo_update(BLKTIME);
+	}
+	t1 = bench_time();
+	xfree(data);
+	secs = len * 320 / 1e6;
+	printf("%-8s %8u %8llu %8llu %10.0f\n",
+	    lowlat ? "lowlat" : "batch", NMSG, nwrites,
+	    (t1 - t0) / NMSG, nwrites / secs);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct mididev *dev;
+
+	bench_init();
+	dev = bench_idle("flushbench");
+	if (dev == NULL)
+		return 1;
+	count_ops = loop_ops;
+	count_ops.write = count_write;
+	dev->ops = &count_ops;
+
+	printf("%-8s %8s %8s %8s %10s\n",
+	    "mode", "msgs", "writes", "ns/msg", "writes/s");
+	bench_run(dev, 0);
+	bench_run(dev, 1);
+
+	bench_done();
+	return 0;
+}
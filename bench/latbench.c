@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * input to output latency benchmark: a loop device is attached and
+ * the song is put in idle mode (ie. input is passed through the
+ * current filter and sent to the output). Then synthetic midi
+ * streams are fed to the device input routine, one message at a
+ * time, and the time each message takes to go through the parser,
+ * the normalizer, the filter, the mixer and the device output buffer
+ * is measured.
+ *
+ * For each stream, the message rate and the median, 99-th
+ * percentile and maximum latencies are printed. If a file name is
+ * given, results are also stored in it, one line per stream, so they
+ * can be compared between runs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "defs.h"
+#include "ev.h"
+#include "mididev.h"
+#include "benchutil.h"
+
+#define NMSG		100000		/* messages per stream */
+#define MAXMSG		256		/* max message size */
+#define SYSEX_LEN	64		/* size of sysex messages */
+
+/*
+ * a stream generator: store the i-th message in the given buffer and
+ * return its size
+ */
+struct stream {
+	char *name;
+	unsigned (*gen)(unsigned, unsigned char *);
+	unsigned nmsg;
+};
+
+unsigned long long lat[NMSG];
+
+/*
+ * volume controllers on all channels, as a fader box would send
+ */
+unsigned
+gen_ctl(unsigned i, unsigned char *buf)
+{
+	buf[0] = 0xb0 | (i & 0xf);
+	buf[1] = 7;
+	buf[2] = (i >> 4) & 0x7f;
+	return 3;
+}
+
+/*
+ * 8-note chords on all 16 channels: note-ons then note-offs
+ */
+unsigned
+gen_chord(unsigned i, unsigned char *buf)
+{
+	unsigned ch, note, off;
+
+	ch = (i >> 3) & 0xf;
+	note = 48 + (i & 7) * 3;
+	off = (i >> 7) & 1;
+	buf[0] = (off ? 0x80 : 0x90) | ch;
+	buf[1] = note;
+	buf[2] = off ? 64 : 100;
+	return 3;
+}
+
+/*
+ * sysex messages of SYSEX_LEN bytes, as a librarian would send
+ */
+unsigned
+gen_sysex(unsigned i, unsigned char *buf)
+{
+	unsigned n;
+
+	buf[0] = 0xf0;
+	buf[1] = 0x7d;
+	for (n = 2; n < SYSEX_LEN - 1; n++)
+		buf[n] = (i + n) & 0x7f;
+	buf[n++] = 0xf7;
+	return n;
+}
+
+/*
+ * pitch bends on a single channel, using running status: only the
+ * first message has a status byte
+ */
+unsigned
+gen_rstatus(unsigned i, unsigned char *buf)
+{
+	unsigned n = 0, val;
+
+	if (i == 0)
+		buf[n++] = 0xe0;
+	val = 0x2000 + ((i & 0xff) << 4);
+	buf[n++] = val & 0x7f;
+	buf[n++] = val >> 7;
+	return n;
+}
+
+struct stream streams[] = {
+	{"ctlflood",	gen_ctl,	NMSG},
+	{"chords",	gen_chord,	NMSG},
+	{"sysex",	gen_sysex,	NMSG / 10},
+	{"rstatus",	gen_rstatus,	NMSG},
+	{NULL,		NULL,		0}
+};
+
+int
+bench_cmp(const void *p1, const void *p2)
+{
+	unsigned long long a = *(unsigned long long *)p1;
+	unsigned long long b = *(unsigned long long *)p2;
+
+	return (a > b) - (a < b);
+}
+
+/*
+ * run the given stream and print the results
+ */
+void
+bench_run(struct mididev *dev, struct stream *s, FILE *out)
+{
+	unsigned char buf[MAXMSG];
+	unsigned long long t0, t1, total;
+	unsigned i, n;
+	double rate;
+
+	total = 0;
+	for (i = 0; i < s->nmsg; i++) {
+		n = s->gen(i, buf);
+		t0 = bench_time();
+		mididev_inputcb(dev, buf, n);
+		t1 = bench_time();
+		lat[i] = t1 - t0;
+		total += lat[i];
+	}
+	qsort(lat, s->nmsg, sizeof(lat[0]), bench_cmp);
+	rate = total > 0 ? 1e9 * s->nmsg / total : 0;
+	printf("%-10s %8u %12.0f %8llu %8llu %8llu\n", s->name,
+	    s->nmsg, rate, lat[s->nmsg / 2], lat[s->nmsg * 99 / 100],
+	    lat[s->nmsg - 1]);
+	if (out) {
+		fprintf(out, "%s %u %.0f %llu %llu %llu\n", s->name,
+		    s->nmsg, rate, lat[s->nmsg / 2], lat[s->nmsg * 99 / 100],
+		    lat[s->nmsg - 1]);
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	struct stream *s;
+	struct mididev *dev;
+	FILE *out;
+
+	if (argc > 2) {
+		fputs("usage: latbench [file]\n", stderr);
+		return 1;
+	}
+	out = NULL;
+	if (argc == 2) {
+		out = fopen(argv[1], "w");
+		if (out == NULL) {
+			perror(argv[1]);
+			return 1;
+		}
+		fprintf(out, "# stream msgs msgs/s p50_ns p99_ns max_ns\n");
+	}
+
+	bench_init();
+	dev = bench_idle("latbench");
+	if (dev == NULL)
+		return 1;
+
+	printf("%-10s %8s %12s %8s %8s %8s\n",
+	    "stream", "msgs", "msgs/s", "p50_ns", "p99_ns", "max_ns");
+	for (s = streams; s->name != NULL; s++)
+		bench_run(dev, s, out);
+
+	bench_done();
+	if (out)
+		fclose(out);
+	return 0;
+}
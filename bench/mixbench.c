@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * output mixer benchmark: event streams are replayed through
+ * mixout_putev(), which looks up and updates the mixer state list
+ * for each event. Loop devices are attached on units 0 to NDEV - 1,
+ * so the output is discarded.
+ *
+ * Without arguments, synthetic streams are used: plain chords (the
+ * state list stays short), then controller-heavy multi-device
+ * streams (the state list holds hundreds of states). Otherwise each
+ * argument is a standard MIDI file, which is imported and whose
+ * tracks are merged and replayed, each track as a separate mixer
+ * input.
+ *
+ * For each stream, the number of events, the mean time per event
+ * and the maximum length of the state list are printed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+#include "defs.h"
+#include "ev.h"
+#include "mididev.h"
+#include "mux.h"
+#include "mixout.h"
+#include "state.h"
+#include "frame.h"
+#include "track.h"
+#include "song.h"
+#include "smf.h"
+#include "benchutil.h"
+
+#define NDEV		4		/* devices to attach */
+#define NEV		200000		/* events per synthetic stream */
+#define NLOOP		10		/* times a file is replayed */
+
+/*
+ * an event and the mixer input it comes from
+ */
+struct bev {
+	struct ev ev;
+	unsigned id;
+};
+
+/*
+ * a synthetic stream generator: store the i-th event in the given
+ * structure
+ */
+struct stream {
+	char *name;
+	void (*gen)(unsigned, struct bev *);
+};
+
+extern struct statelist mixout_slist;
+
+/*
+ * 8-note chords on all channels of the first device: note-ons then
+ * note-offs
+ */
+void
+gen_chord(unsigned i, struct bev *b)
+{
+	b->ev.cmd = ((i >> 7) & 1) ? EV_NOFF : EV_NON;
+	b->ev.dev = 0;
+	b->ev.ch = (i >> 3) & 0xf;
+	b->ev.note_num = 48 + (i & 7) * 3;
+	b->ev.note_vel = b->ev.cmd == EV_NON ? 100 : EV_NOFF_DEFAULTVEL;
+	b->id = 0;
+}
+
+/*
+ * 16 controllers on all channels of all devices, as a multi-device
+ * recording of fader boxes would send
+ */
+void
+gen_ctl(unsigned i, struct bev *b)
+{
+	b->ev.cmd = EV_XCTL;
+	b->ev.dev = i % NDEV;
+	b->ev.ch = (i / NDEV) & 0xf;
+	b->ev.ctl_num = 16 + ((i / (NDEV * 16)) & 0xf);
+	b->ev.ctl_val = (i >> 4) & 0x3fff;
+	b->id = b->ev.dev;
+}
+
+/*
+ * same as above, but with bends and notes held on all channels, so
+ * the state list contains various types of states
+ */
+void
+gen_mixed(unsigned i, struct bev *b)
+{
+	unsigned j;
+
+	switch (i & 3) {
+	case 0:
+		gen_ctl(i >> 2, b);
+		break;
+	case 1:
+		b->ev.cmd = EV_BEND;
+		b->ev.dev = (i >> 2) % NDEV;
+		b->ev.ch = (i >> 4) & 0xf;
+		b->ev.bend_val = 0x2000 + ((i >> 8) & 0xfff);
+		b->id = b->ev.dev;
+		break;
+	default:
+		j = (i >> 2) * 2 + (i & 1);
+		gen_chord(j, b);
+		b->ev.dev = (j >> 8) % NDEV;
+		b->id = b->ev.dev;
+	}
+}
+
+struct stream streams[] = {
+	{"chords",	gen_chord},
+	{"ctl",		gen_ctl},
+	{"mixed",	gen_mixed},
+	{NULL,		NULL}
+};
+
+/*
+ * feed the given events to the mixer and print the results
+ */
+void
+bench_run(char *name, struct bev *evs, unsigned nev, unsigned nloop)
+{
+	unsigned long long t0, total;
+	unsigned i, n, maxlen;
+
+	maxlen = 0;
+	total = 0;
+	for (n = 0; n < nloop; n++) {
+		statelist_empty(&mixout_slist);
+		t0 = bench_time();
+		for (i = 0; i < nev; i++) {
+			mixout_putev(&evs[i].ev, evs[i].id);
+			if (maxlen < mixout_slist.nstates)
+				maxlen = mixout_slist.nstates;
+		}
+		total += bench_time() - t0;
+	}
+	statelist_empty(&mixout_slist);
+	printf("%-16s %8u %8llu %8u\n", name, nev * nloop,
+	    nev > 0 ? total / ((unsigned long long)nev * nloop) : 0,
+	    maxlen);
+}
+
+/*
+ * import the given file and store its voice events in the given
+ * array, in the order they would be played. Return the number of
+ * events
+ */
+unsigned
+bench_load(char *path, struct bev **pevs)
+{
+	struct song *s;
+	struct songtrk *t;
+	struct seqptr *sp[DEFAULT_MAXNSEQPTRS];
+	struct state *st;
+	struct bev *evs, *nevs;
+	unsigned i, n, ntrk, nev, size, done;
+
+	s = song_importsmf(path);
+	if (s == NULL)
+		return 0;
+	ntrk = 0;
+	SONG_FOREACH_TRK(s, t) {
+		if (ntrk == DEFAULT_MAXNSEQPTRS)
+			break;
+		sp[ntrk++] = seqptr_new(&t->track);
+	}
+	nev = 0;
+	size = 1024;
+	evs = xmalloc(size * sizeof(struct bev), "bev");
+	for (;;) {
+		for (i = 0; i < ntrk; i++) {
+			while ((st = seqptr_evget(sp[i])) != NULL) {
+				if (nev == size) {
+					size *= 2;
+					nevs = xmalloc(size *
+					    sizeof(struct bev), "bev");
+					for (n = 0; n < nev; n++)
+						nevs[n] = evs[n];
+					xfree(evs);
+					evs = nevs;
+				}
+				evs[nev].ev = st->ev;
+				evs[nev].id = i;
+				nev++;
+			}
+		}
+		done = 1;
+		for (i = 0; i < ntrk; i++) {
+			if (!seqptr_eot(sp[i])) {
+				seqptr_ticskip(sp[i], 1);
+				done = 0;
+			}
+		}
+		if (done)
+			break;
+	}
+	for (i = 0; i < ntrk; i++)
+		seqptr_del(sp[i]);
+	song_delete(s);
+	if (nev == 0) {
+		xfree(evs);
+		return 0;
+	}
+	*pevs = evs;
+	return nev;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct stream *s;
+	struct bev *evs;
+	unsigned i, nev;
+
+	bench_init();
+	for (i = 0; i < NDEV; i++) {
+		if (!mididev_attach(i, "loop:", MIDIDEV_MODE_OUT)) {
+			fputs("couldn't attach loop device\n", stderr);
+			return 1;
+		}
+	}
+	mux_open();
+
+	printf("%-16s %8s %8s %8s\n", "stream", "events", "ns/ev", "maxlen");
+	if (argc == 1) {
+		evs = xmalloc(NEV * sizeof(struct bev), "bev");
+		for (s = streams; s->name != NULL; s++) {
+			for (i = 0; i < NEV; i++)
+				s->gen(i, &evs[i]);
+			bench_run(s->name, evs, NEV, 1);
+		}
+		xfree(evs);
+	} else {
+		for (i = 1; i < argc; i++) {
+			nev = bench_load(argv[i], &evs);
+			if (nev == 0)
+				continue;
+			bench_run(argv[i], evs, nev, NLOOP);
+			xfree(evs);
+		}
+	}
+
+	mux_close();
+	bench_done();
+	return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * startup benchmark: run "midish -b" with short scripts and measure
+ * the time it takes to start, run the script and exit, as well as the
+ * maximum resident set size of the process. Scripts are: nothing
+ * (empty session), loading sample.sng and importing a large standard
+ * MIDI file, generated by the benchmark.
+ *
+ * For each script, the mean and minimum times in milliseconds and the
+ * maximum RSS in kilobytes are printed.
+ */
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "benchutil.h"
+
+#define NRUN		10		/* runs per script */
+#define NNOTES		100000		/* notes of the large file */
+#define SMF_PATH	"bench/startbench.mid"
+
+struct script {
+	char *name;
+	char *cmds;
+};
+
+struct script scripts[] = {
+	{"empty",	""},
+	{"sample",	"load \"sample.sng\"\n"},
+	{"import",	"import \"" SMF_PATH "\"\n"},
+	{NULL,		NULL}
+};
+
+/*
+ * store a variable length number
+ */
+void
+smf_putvar(FILE *f, unsigned long val)
+{
+	unsigned char buf[4];
+	int n = 0;
+
+	do {
+		buf[n++] = val & 0x7f;
+		val >>= 7;
+	} while (val > 0);
+	while (--n > 0)
+		fputc(buf[n] | 0x80, f);
+	fputc(buf[0], f);
+}
+
+void
+smf_put32(FILE *f, unsigned long val)
+{
+	fputc((val >> 24) & 0xff, f);
+	fputc((val >> 16) & 0xff, f);
+	fputc((val >> 8) & 0xff, f);
+	fputc(val & 0xff, f);
+}
+
+/*
+ * generate a format 0 file with NNOTES notes on all channels
+ */
+int
+smf_gen(char *path)
+{
+	FILE *f;
+	long start, end;
+	unsigned i, ch, note;
+
+	f = fopen(path, "wb");
+	if (f == NULL) {
+		perror(path);
+		return 0;
+	}
+	fwrite("MThd\0\0\0\6\0\0\0\1\0\x18", 14, 1, f);
+	fwrite("MTrk", 4, 1, f);
+	smf_put32(f, 0);
+	start = ftell(f);
+	for (i = 0; i < NNOTES; i++) {
+		ch = i & 0xf;
+		note = 36 + (i % 48);
+		smf_putvar(f, ch == 0 ? 6 : 0);
+		fputc(0x90 | ch, f);
+		fputc(note, f);
+		fputc(100, f);
+		smf_putvar(f, 3);
+		fputc(0x80 | ch, f);
+		fputc(note, f);
+		fputc(64, f);
+	}
+	fwrite("\0\xff\x2f\0", 4, 1, f);
+	end = ftell(f);
+	fseek(f, start - 4, SEEK_SET);
+	smf_put32(f, end - start);
+	fclose(f);
+	return 1;
+}
+
+/*
+ * run midish with the given commands on its standard input, return
+ * the time it took and its max RSS
+ */
+int
+bench_run(char *prog, char *cmds, unsigned long long *time, long *rss)
+{
+	struct rusage ru;
+	unsigned long long t0;
+	int fds[2], status, null;
+	pid_t pid;
+
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return 0;
+	}
+	t0 = bench_time();
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 0;
+	}
+	if (pid == 0) {
+		close(fds[1]);
+		null = open("/dev/null", O_WRONLY);
+		dup2(fds[0], 0);
+		dup2(null, 1);
+		dup2(null, 2);
+		execl(prog, prog, "-b", (char *)NULL);
+		_exit(1);
+	}
+	close(fds[0]);
+	write(fds[1], cmds, strlen(cmds));
+	close(fds[1]);
+	if (wait4(pid, &status, 0, &ru) < 0) {
+		perror("wait4");
+		return 0;
+	}
+	*time = bench_time() - t0;
+	*rss = ru.ru_maxrss;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "%s: failed\n", prog);
+		return 0;
+	}
+	return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+	struct script *s;
+	unsigned long long t, total, min;
+	long rss, maxrss;
+	char *prog;
+	unsigned i;
+
+	if (argc > 2) {
+		fputs("usage: startbench [midish]\n", stderr);
+		return 1;
+	}
+	prog = (argc == 2) ? argv[1] : "./midish";
+	if (!smf_gen(SMF_PATH))
+		return 1;
+	printf("%-10s %8s %8s %8s\n", "script", "mean_ms", "min_ms", "rss_kB");
+	for (s = scripts; s->name != NULL; s++) {
+		total = 0;
+		min = ~0ULL;
+		maxrss = 0;
+		for (i = 0; i < NRUN; i++) {
+			if (!bench_run(prog, s->cmds, &t, &rss))
+				return 1;
+			total += t;
+			if (min > t)
+				min = t;
+			if (maxrss < rss)
+				maxrss = rss;
+		}
+		printf("%-10s %8.2f %8.2f %8ld\n", s->name,
+		    total / 1e6 / NRUN, min / 1e6, maxrss);
+	}
+	unlink(SMF_PATH);
+	return 0;
+}
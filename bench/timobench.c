@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * micro-benchmark of the timeout routines: schedule and cancel
+ * a large number of timeouts, then schedule them again and let
+ * them expire by advancing the clock by 1ms steps, as the
+ * mux does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+#include "timo.h"
+#include "benchutil.h"
+
+#define NTIMO		100000
+#define MAXDELTA	(10 * 1000 * 1000 * 24)	/* 10s */
+#define STEP		(1000 * 24)		/* 1ms */
+
+struct timo timos[NTIMO];
+unsigned ncalls, nlate;
+
+void
+bench_cb(void *arg)
+{
+	struct timo *o = arg;
+	int diff;
+
+	diff = timo_abstime - o->val;
+	if (diff < 0 || diff >= STEP)
+		nlate++;
+	ncalls++;
+}
+
+int
+main(void)
+{
+	unsigned i;
+	unsigned long long t0, t1, t2;
+
+	srandom(1);
+	timo_init();
+	for (i = 0; i < NTIMO; i++)
+		timo_set(&timos[i], bench_cb, &timos[i]);
+
+	t0 = bench_time();
+	for (i = 0; i < NTIMO; i++)
+		timo_add(&timos[i], 1 + random() % MAXDELTA);
+	t1 = bench_time();
+	for (i = 0; i < NTIMO; i++)
+		timo_del(&timos[NTIMO - 1 - i]);
+	t2 = bench_time();
+	printf("timo_add: %u timeouts, %.1f ns/op\n",
+	    NTIMO, (double)(t1 - t0) / NTIMO);
+	printf("timo_del: %u timeouts, %.1f ns/op\n",
+	    NTIMO, (double)(t2 - t1) / NTIMO);
+
+	for (i = 0; i < NTIMO; i++)
+		timo_add(&timos[i], 1 + random() % MAXDELTA);
+	t0 = bench_time();
+	while (ncalls < NTIMO)
+		timo_update(STEP);
+	t1 = bench_time();
+	printf("timo_update: %u timeouts expired, %.1f ns/op\n",
+	    NTIMO, (double)(t1 - t0) / NTIMO);
+	timo_done();
+	if (nlate > 0) {
+		fprintf(stderr, "%u timeouts expired at the wrong time\n",
+		    nlate);
+		return 1;
+	}
+	return 0;
+}
@@ -33,6 +33,8 @@
 #include "builtin.h"
 #include "version.h"
 #include "undo.h"
+#include "rtstat.h"
+#include "pool.h"
 
 unsigned
 blt_info(struct exec *o, struct data **r)
@@ -135,7 +137,7 @@ unsigned
 blt_debug(struct exec *o, struct data **r)
 {
 	extern unsigned filt_debug, mididev_debug, mux_debug, mixout_debug,
-	    norm_debug, pool_debug, song_debug,
+	    norm_debug, othread_debug, pool_debug, song_debug,
 	    timo_debug;
 	char *flag;
 	long value;
@@ -154,6 +156,8 @@ blt_debug(struct exec *o, struct data **r)
 		mux_debug = value;
 	} else if (str_eq(flag, "norm")) {
 		norm_debug = value;
+	} else if (str_eq(flag, "othread")) {
+		othread_debug = value;
 	} else if (str_eq(flag, "pool")) {
 		pool_debug = value;
 	} else if (str_eq(flag, "song")) {
@@ -947,6 +951,42 @@ blt_export(struct exec *o, struct data **r)
 	return song_exportsmf(usong, filename);
 }
 
+unsigned
+blt_render(struct exec *o, struct data **r)
+{
+	char *filename;
+	struct song *s;
+	struct songtrk *t;
+	unsigned res;
+
+	if (!exec_lookupstring(o, "filename", &filename)) {
+		return 0;
+	}
+	if (mididev_clksrc || mididev_mtcsrc) {
+		cons_errs(o->procname, "can't render with external clock");
+		return 0;
+	}
+	if (usong->loop) {
+		cons_errs(o->procname, "can't render in loop mode");
+		return 0;
+	}
+	song_stop(usong);
+
+	/*
+	 * render in the single track of a new song with the same
+	 * tempo map, and export it
+	 */
+	s = song_new();
+	s->tics_per_unit = usong->tics_per_unit;
+	track_clear(&s->meta);
+	track_move(&usong->meta, 0, ~0U, NULL, &s->meta, 1, 0);
+	t = song_trknew(s, "render");
+	song_render(usong, &t->track);
+	res = song_exportsmf(s, filename);
+	song_delete(s);
+	return res;
+}
+
 unsigned
 blt_import(struct exec *o, struct data **r)
 {
@@ -1270,6 +1310,7 @@ blt_mcut(struct exec *o, struct data **r)
 		track_merge(&usong->meta, &t2);
 	}
 	undo_track_diff(usong);
+	track_done(&paste);
 	track_done(&t1);
 	track_done(&t2);
 
@@ -1612,6 +1653,41 @@ blt_tapev(struct exec *o, struct data **r)
 	return 1;
 }
 
+unsigned
+blt_thin(struct exec *o, struct data **r)
+{
+	struct evspec es;
+	long msec, delta, smooth;
+
+	if (!exec_lookupevspec(o, "evspec", &es, 0) ||
+	    !exec_lookuplong(o, "msec", &msec) ||
+	    !exec_lookuplong(o, "delta", &delta) ||
+	    !exec_lookuplong(o, "smooth", &smooth)) {
+		return 0;
+	}
+	if (es.cmd != EVSPEC_XCTL && es.cmd != EVSPEC_BEND &&
+	    es.cmd != EVSPEC_CAT) {
+		cons_errs(o->procname,
+		    "only controllers, bender and channel aftertouch "
+		    "can be thinned");
+		return 0;
+	}
+	if (msec < 0 || msec > NORM_THIN_MAXMSEC) {
+		cons_errs(o->procname, "msec must be in the 0..10000 range");
+		return 0;
+	}
+	if (delta < 0 || delta > EV_MAXFINE) {
+		cons_errs(o->procname, "delta must be in the 0..16383 range");
+		return 0;
+	}
+	if (smooth < 0 || smooth > NORM_THIN_MAXSMOOTH) {
+		cons_errs(o->procname, "smooth must be in the 0..99 range");
+		return 0;
+	}
+	norm_thinset(&usong->thinlist, &es, msec, delta, smooth);
+	return 1;
+}
+
 unsigned
 blt_undo(struct exec *o, struct data **r)
 {
@@ -2941,6 +3017,8 @@ blt_freset(struct exec *o, struct data **r)
 		norm_shut();
 	undo_filt_save(usong, &f->filt, o->procname, f->name.str);
 	filt_reset(&f->filt);
+	if (mux_isopen)
+		filt_compile(&f->filt);
 	return 1;
 }
 
@@ -2963,6 +3041,8 @@ blt_fmap(struct exec *o, struct data **r)
 		norm_shut();
 	undo_filt_save(usong, &f->filt, o->procname, f->name.str);
 	filt_mapnew(&f->filt, &from, &to);
+	if (mux_isopen)
+		filt_compile(&f->filt);
 	return 1;
 }
 
@@ -2985,6 +3065,8 @@ blt_funmap(struct exec *o, struct data **r)
 		norm_shut();
 	undo_filt_save(usong, &f->filt, o->procname, f->name.str);
 	filt_mapdel(&f->filt, &from, &to);
+	if (mux_isopen)
+		filt_compile(&f->filt);
 	return 1;
 }
 
@@ -3018,6 +3100,8 @@ blt_ftransp(struct exec *o, struct data **r)
 		norm_shut();
 	undo_filt_save(usong, &f->filt, o->procname, f->name.str);
 	filt_transp(&f->filt, &es, plus);
+	if (mux_isopen)
+		filt_compile(&f->filt);
 	return 1;
 }
 
@@ -3049,6 +3133,8 @@ blt_fvcurve(struct exec *o, struct data **r)
 		norm_shut();
 	undo_filt_save(usong, &f->filt, o->procname, f->name.str);
 	filt_vcurve(&f->filt, &es, weight);
+	if (mux_isopen)
+		filt_compile(&f->filt);
 	return 1;
 }
 
@@ -3078,6 +3164,8 @@ blt_fchgxxx(struct exec *o, struct data **r, int input, int swap)
 		filt_chgin(&f->filt, &from, &to, swap);
 	else
 		filt_chgout(&f->filt, &from, &to, swap);
+	if (mux_isopen)
+		filt_compile(&f->filt);
 	return 1;
 }
 
@@ -3650,6 +3738,259 @@ blt_dclkrate(struct exec *o, struct data **r)
 	return 1;
 }
 
+unsigned
+blt_tickless(struct exec *o, struct data **r)
+{
+	long flag;
+
+	if (!song_try_mode(usong, 0)) {
+		return 0;
+	}
+	if (!exec_lookupbool(o, "flag", &flag)) {
+		return 0;
+	}
+	mux_tickless = flag;
+	return 1;
+}
+
+unsigned
+blt_dothread(struct exec *o, struct data **r)
+{
+	long unit, flag;
+
+	if (!song_try_mode(usong, 0)) {
+		return 0;
+	}
+	if (!exec_lookuplong(o, "devnum", &unit) ||
+	    !exec_lookupbool(o, "flag", &flag)) {
+		return 0;
+	}
+	if (unit < 0 || unit >= DEFAULT_MAXNDEVS || !mididev_byunit[unit]) {
+		cons_errs(o->procname, "bad device number");
+		return 0;
+	}
+	if (flag && mididev_byunit[unit]->ops->twrite == NULL) {
+		cons_errs(o->procname,
+		    "device can't be written from a separate thread");
+		return 0;
+	}
+	mididev_byunit[unit]->othread = flag;
+	return 1;
+}
+
+unsigned
+blt_dinject(struct exec *o, struct data **r)
+{
+	struct mididev *dev;
+	struct data *byte;
+	struct var *arg;
+	unsigned char buf[MIDIDEV_BUFLEN];
+	unsigned len;
+	long unit;
+
+	if (!exec_lookuplong(o, "devnum", &unit)) {
+		return 0;
+	}
+	if (unit < 0 || unit >= DEFAULT_MAXNDEVS || !mididev_byunit[unit]) {
+		cons_errs(o->procname, "bad device number");
+		return 0;
+	}
+	dev = mididev_byunit[unit];
+	if (dev->ops != &loop_ops || !(dev->mode & MIDIDEV_MODE_IN)) {
+		cons_errs(o->procname, "not a loop input device");
+		return 0;
+	}
+	arg = exec_varlookup(o, "data");
+	if (!arg) {
+		log_puts("blt_dinject: data: no such param\n");
+		panic();
+	}
+	if (arg->data->type != DATA_LIST) {
+		cons_errs(o->procname, "data must be a list of numbers");
+		return 0;
+	}
+	len = 0;
+	for (byte = arg->data->val.list; byte != 0; byte = byte->next) {
+		if (byte->type != DATA_LONG) {
+			cons_errs(o->procname, "only bytes allowed as data");
+			return 0;
+		}
+		if (byte->val.num < 0 || byte->val.num > 0xff) {
+			cons_errs(o->procname, "data out of range");
+			return 0;
+		}
+		if (len == MIDIDEV_BUFLEN) {
+			if (!loop_inject(dev, buf, len))
+				return 0;
+			len = 0;
+		}
+		buf[len++] = byte->val.num;
+	}
+	return loop_inject(dev, buf, len);
+}
+
+unsigned
+blt_lookahead(struct exec *o, struct data **r)
+{
+	long msec;
+
+	if (!song_try_mode(usong, 0)) {
+		return 0;
+	}
+	if (!exec_lookuplong(o, "msec", &msec)) {
+		return 0;
+	}
+	if (msec < 0 || msec > 1000) {
+		cons_errs(o->procname, "look-ahead must be in the 0..1000 range");
+		return 0;
+	}
+	mux_lookahead = msec * 24000;
+	return 1;
+}
+
+unsigned
+blt_lowlat(struct exec *o, struct data **r)
+{
+	long flag;
+
+	if (!exec_lookupbool(o, "flag", &flag)) {
+		return 0;
+	}
+	norm_lowlat = flag;
+	return 1;
+}
+
+unsigned
+blt_rtstat(struct exec *o, struct data **r)
+{
+	struct rtstat *stats[] = {&rtstat_timer, &rtstat_tick, &rtstat_input};
+	unsigned i;
+
+	for (i = 0; i < sizeof(stats) / sizeof(stats[0]); i++) {
+		rtstat_output(stats[i], tout);
+		rtstat_reset(stats[i]);
+	}
+	textout_putstr(tout, "rate {\n");
+	textout_shiftright(tout);
+	textout_putstr(tout, "timer ");
+	textout_putlong(tout, mux_timerrate);
+	textout_putstr(tout, "\n");
+	textout_putstr(tout, "timo ");
+	textout_putlong(tout, mux_timorate);
+	textout_putstr(tout, "\n");
+	textout_shiftleft(tout);
+	textout_putstr(tout, "}\n");
+	return 1;
+}
+
+/*
+ * print a line with a name followed by the given numbers
+ */
+void
+blt_memline(char *name, unsigned long *vals, unsigned nvals)
+{
+	unsigned i;
+
+	textout_putstr(tout, name);
+	for (i = 0; i < nvals; i++) {
+		textout_putstr(tout, " ");
+		textout_putlong(tout, vals[i]);
+	}
+	textout_putstr(tout, "\n");
+}
+
+unsigned
+blt_meminfo(struct exec *o, struct data **r)
+{
+	struct memtag *m;
+	struct pool *p;
+	struct songtrk *t;
+	struct undo *u;
+	unsigned long vals[4], size;
+
+	textout_putstr(tout, "xmalloc {\t\t# used peak allocs\n");
+	textout_shiftright(tout);
+	vals[0] = mem_used;
+	vals[1] = mem_maxused;
+	blt_memline("total", vals, 2);
+	for (m = mem_tags; m < mem_tags + mem_ntags; m++) {
+		vals[0] = m->used;
+		vals[1] = m->maxused;
+		vals[2] = m->nalloc;
+		blt_memline(m->tag, vals, 3);
+	}
+	textout_shiftleft(tout);
+	textout_putstr(tout, "}\n");
+
+	textout_putstr(tout, "pool {\t\t\t# used peak size bytes\n");
+	textout_shiftright(tout);
+	vals[0] = seqev_used;
+	vals[1] = seqev_maxused;
+	vals[2] = seqev_poolsize();
+	vals[3] = seqev_nchunks * SEQEV_CHUNKSIZE;
+	blt_memline("seqev", vals, 4);
+	for (p = pool_list; p != NULL; p = p->next) {
+		vals[0] = p->used;
+		vals[1] = p->maxused;
+		vals[2] = p->itemnum;
+		vals[3] = p->nslabs * p->slabsize;
+		blt_memline(p->name, vals, 4);
+	}
+	textout_shiftleft(tout);
+	textout_putstr(tout, "}\n");
+
+	textout_putstr(tout, "track {\t\t\t# events bytes\n");
+	textout_shiftright(tout);
+	SONG_FOREACH_TRK(usong, t) {
+		vals[0] = track_numev(&t->track);
+		vals[1] = track_memsize(&t->track);
+		blt_memline(t->name.str, vals, 2);
+	}
+	textout_shiftleft(tout);
+	textout_putstr(tout, "}\n");
+
+	/*
+	 * the first record of each operation (in push order) has the
+	 * function name, records pushed later are before it in the list
+	 */
+	textout_putstr(tout, "undo {\t\t\t# bytes\n");
+	textout_shiftright(tout);
+	size = 0;
+	for (u = usong->undo; u != NULL; u = u->next) {
+		size += sizeof(struct undo) + u->size;
+		if (u->type == UNDO_TRACK && u->u.track.jbuf != NULL)
+			size += u->u.track.jlen;
+		if (u->func == NULL)
+			continue;
+		textout_putstr(tout, u->func);
+		if (u->name) {
+			textout_putstr(tout, " ");
+			textout_putstr(tout, u->name);
+		}
+		blt_memline("", &size, 1);
+		size = 0;
+	}
+	vals[0] = usong->undo_size;
+	blt_memline("total", vals, 1);
+	vals[0] = undo_jend;
+	blt_memline("journal", vals, 1);
+	textout_shiftleft(tout);
+	textout_putstr(tout, "}\n");
+	return 1;
+}
+
+unsigned
+blt_poolshrink(struct exec *o, struct data **r)
+{
+	long flag;
+
+	if (!exec_lookupbool(o, "flag", &flag)) {
+		return 0;
+	}
+	pool_shrink = flag;
+	return 1;
+}
+
 unsigned
 blt_dinfo(struct exec *o, struct data **r)
 {
@@ -3732,6 +4073,10 @@ blt_dinfo(struct exec *o, struct data **r)
 	textout_putlong(tout, mididev_byunit[unit]->ticrate);
 	textout_putstr(tout, "\n");
 
+	if (dev->othread) {
+		textout_putstr(tout, "othread\t\t\t# writes from a thread\n");
+	}
+
 	textout_shiftleft(tout);
 	textout_putstr(tout, "}\n");
 	return 1;
@@ -64,6 +64,7 @@ unsigned blt_save(struct exec *, struct data **);
 unsigned blt_load(struct exec *, struct data **);
 unsigned blt_reset(struct exec *, struct data **);
 unsigned blt_export(struct exec *, struct data **);
+unsigned blt_render(struct exec *, struct data **);
 unsigned blt_import(struct exec *, struct data **);
 unsigned blt_idle(struct exec *, struct data **);
 unsigned blt_play(struct exec *, struct data **);
@@ -87,6 +88,7 @@ unsigned blt_metro(struct exec *, struct data **);
 unsigned blt_metrocf(struct exec *, struct data **);
 unsigned blt_tap(struct exec *, struct data **);
 unsigned blt_tapev(struct exec *, struct data **);
+unsigned blt_thin(struct exec *, struct data **);
 unsigned blt_undo(struct exec *, struct data **);
 unsigned blt_undolist(struct exec *, struct data **);
 
@@ -176,6 +178,14 @@ unsigned blt_dmmctx(struct exec *, struct data **);
 unsigned blt_dclkrx(struct exec *, struct data **);
 unsigned blt_dclktx(struct exec *, struct data **);
 unsigned blt_dclkrate(struct exec *, struct data **);
+unsigned blt_tickless(struct exec *, struct data **);
+unsigned blt_dothread(struct exec *, struct data **);
+unsigned blt_dinject(struct exec *, struct data **);
+unsigned blt_lookahead(struct exec *, struct data **);
+unsigned blt_lowlat(struct exec *, struct data **);
+unsigned blt_rtstat(struct exec *, struct data **);
+unsigned blt_meminfo(struct exec *, struct data **);
+unsigned blt_poolshrink(struct exec *, struct data **);
 unsigned blt_dinfo(struct exec *, struct data **);
 unsigned blt_dixctl(struct exec *, struct data **);
 unsigned blt_doxctl(struct exec *, struct data **);
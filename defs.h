@@ -67,28 +67,30 @@
 #define DEFAULT_MAXNCHANS	(DEFAULT_MAXNDEVS * 16)
 
 /*
- * maximum number of events
+ * number of events memory is kept for; memory is allocated as needed,
+ * but it's not freed below this
  */
 #define DEFAULT_MAXNSEQEVS	400000
 
 /*
- * maximum number of tracks
+ * number of track pointers (roughly the number of tracks) memory is
+ * kept for
  */
 #define DEFAULT_MAXNSEQPTRS	200
 
 /*
- * maximum number of filter states (roughly maximum number of
- * simultaneous notes
+ * number of filter states (roughly maximum number of simultaneous
+ * notes) memory is kept for
  */
 #define DEFAULT_MAXNSTATES	10000
 
 /*
- * maximum number of system exclusive messages
+ * number of system exclusive messages memory is kept for
  */
 #define DEFAULT_MAXNSYSEXS	2000
 
 /*
- * maximum number of chunks (each sysex is a set of chunks)
+ * number of chunks (each sysex is a set of chunks) memory is kept for
  */
 #define DEFAULT_MAXNCHUNKS	(DEFAULT_MAXNSYSEXS * 2)
 
@@ -155,10 +157,16 @@
 #define DEFAULT_METRO_LO_VEL	90
 
 /*
- * max memory usage allowed for undo
+ * max memory usage allowed for undo, older track data is moved
+ * to the undo journal
  */
 #define UNDO_MAXSIZE		(4 * 1024 * 1024)
 
+/*
+ * max bytes written to the undo journal per main loop iteration
+ */
+#define UNDO_FLUSHSIZE		(16 * 1024)
+
 /*
  * output source prioriries
  */
@@ -50,7 +50,11 @@ filtnode_new(struct evspec *from, struct filtnode **loc)
 	s = xmalloc(sizeof(struct filtnode), "filtnode");
 	s->dstlist = NULL;
 	s->es = *from;
+	s->mark = 0;
 	s->next = *loc;
+	if (s->next)
+		s->next->prev = &s->next;
+	s->prev = loc;
 	*loc = s;
 	return s;
 }
@@ -66,6 +70,8 @@ filtnode_del(struct filtnode **loc)
 	while (s->dstlist)
 		filtnode_del(&s->dstlist);
 	*loc = s->next;
+	if (s->next)
+		s->next->prev = loc;
 	xfree(s);
 }
 
@@ -123,6 +129,193 @@ filtnode_mksrc(struct filtnode **root, struct evspec *from)
 	return filtnode_new(from, ps);
 }
 
+/*
+ * get the range of cells of the index containing the given set
+ */
+void
+filt_cellrange(struct evspec *es, unsigned *dmin, unsigned *dmax,
+    unsigned *cmin, unsigned *cmax)
+{
+	*dmin = es->dev_min;
+	*dmax = es->dev_max <= EV_MAXDEV ? es->dev_max : EV_MAXDEV;
+	*cmin = es->ch_min;
+	*cmax = es->ch_max <= EV_MAXCH ? es->ch_max : EV_MAXCH;
+}
+
+/*
+ * add the given map source to the index
+ */
+void
+filt_srcadd(struct filt *o, struct filtnode *s)
+{
+	struct filtcell *c;
+	struct filtnode **srcs;
+	unsigned dev, ch, dmin, dmax, cmin, cmax, i;
+
+	if (s->es.cmd == EVSPEC_EMPTY)
+		return;
+	filt_cellrange(&s->es, &dmin, &dmax, &cmin, &cmax);
+	for (dev = dmin; dev <= dmax; dev++) {
+		for (ch = cmin; ch <= cmax; ch++) {
+			c = &o->cells[dev * (EV_MAXCH + 1) + ch];
+			if (c->nsrcs == c->maxsrcs) {
+				c->maxsrcs = c->maxsrcs ? 2 * c->maxsrcs : 4;
+				srcs = xmalloc(c->maxsrcs *
+				    sizeof(struct filtnode *), "filtcell");
+				for (i = 0; i < c->nsrcs; i++)
+					srcs[i] = c->srcs[i];
+				if (c->srcs)
+					xfree(c->srcs);
+				c->srcs = srcs;
+			}
+			c->srcs[c->nsrcs++] = s;
+		}
+	}
+}
+
+/*
+ * delete the map source at the given location and remove it from the
+ * index
+ */
+void
+filt_srcdel(struct filt *o, struct filtnode **loc)
+{
+	struct filtnode *s = *loc;
+	struct filtcell *c;
+	unsigned dev, ch, dmin, dmax, cmin, cmax, i;
+
+	if (o->cells && s->es.cmd != EVSPEC_EMPTY) {
+		filt_cellrange(&s->es, &dmin, &dmax, &cmin, &cmax);
+		for (dev = dmin; dev <= dmax; dev++) {
+			for (ch = cmin; ch <= cmax; ch++) {
+				c = &o->cells[dev * (EV_MAXCH + 1) + ch];
+				for (i = 0; c->srcs[i] != s; i++)
+					; /* nothing */
+				c->srcs[i] = c->srcs[--c->nsrcs];
+			}
+		}
+	}
+	if (o->maptail == &s->next)
+		o->maptail = loc;
+	filtnode_del(loc);
+}
+
+/*
+ * free the index of map sources
+ */
+void
+filt_unindex(struct filt *o)
+{
+	unsigned i;
+
+	if (o->cells == NULL)
+		return;
+	for (i = 0; i < FILT_NCELLS; i++) {
+		if (o->cells[i].srcs)
+			xfree(o->cells[i].srcs);
+	}
+	xfree(o->cells);
+	o->cells = NULL;
+}
+
+/*
+ * build the index of map sources
+ */
+void
+filt_index(struct filt *o)
+{
+	struct filtnode *s, **ps;
+	unsigned i;
+
+	filt_unindex(o);
+	o->cells = xmalloc(FILT_NCELLS * sizeof(struct filtcell),
+	    "filtcell");
+	for (i = 0; i < FILT_NCELLS; i++) {
+		o->cells[i].srcs = NULL;
+		o->cells[i].nsrcs = o->cells[i].maxsrcs = 0;
+	}
+	o->mark = 0;
+	for (ps = &o->map; (s = *ps) != NULL; ps = &s->next) {
+		s->prev = ps;
+		s->mark = 0;
+		filt_srcadd(o, s);
+	}
+	o->maptail = ps;
+}
+
+/*
+ * same as filtnode_mksrc() for map sources, but use the index to
+ * find sources intersecting the given set. Since any two sources are
+ * either disjoint or one includes the other, and in the latter case
+ * the smaller one is first on the list, the first source including
+ * the given set is the smallest one.
+ */
+struct filtnode *
+filt_mksrc(struct filt *o, struct evspec *from)
+{
+	struct filtnode *s, *best, **loc;
+	struct filtcell *c;
+	unsigned dev, ch, dmin, dmax, cmin, cmax, i;
+
+	if (from->cmd == EVSPEC_EMPTY ||
+	    from->dev_min > from->dev_max || from->dev_max > EV_MAXDEV ||
+	    from->ch_min > from->ch_max || from->ch_max > EV_MAXCH) {
+		/*
+		 * the set may not be in the cells it intersects,
+		 * this is rare, so just rebuild the index
+		 */
+		s = filtnode_mksrc(&o->map, from);
+		filt_index(o);
+		return s;
+	}
+	if (o->cells == NULL)
+		filt_index(o);
+	o->mark++;
+	best = NULL;
+	filt_cellrange(from, &dmin, &dmax, &cmin, &cmax);
+	for (dev = dmin; dev <= dmax; dev++) {
+		for (ch = cmin; ch <= cmax; ch++) {
+			c = &o->cells[dev * (EV_MAXCH + 1) + ch];
+			for (i = 0; i < c->nsrcs;) {
+				s = c->srcs[i];
+				if (s->mark == o->mark) {
+					i++;
+					continue;
+				}
+				s->mark = o->mark;
+				if (!evspec_isec(&s->es, from)) {
+					i++;
+					continue;
+				}
+				if (!evspec_in(from, &s->es)) {
+					if (filt_debug) {
+						log_puts("filt_mksrc: ");
+						evspec_log(&s->es);
+						log_puts(": src intersect\n");
+					}
+					filt_srcdel(o, s->prev);
+					continue;
+				}
+				if (best == NULL ||
+				    evspec_in(&s->es, &best->es))
+					best = s;
+				i++;
+			}
+		}
+	}
+	if (best && evspec_eq(from, &best->es)) {
+		if (filt_debug)
+			log_puts("filt_mksrc: exact match\n");
+		return best;
+	}
+	loc = best ? best->prev : o->maptail;
+	s = filtnode_new(from, loc);
+	if (o->maptail == loc)
+		o->maptail = &s->next;
+	filt_srcadd(o, s);
+	return s;
+}
+
 /*
  * find a node (or create one) such that the given evspec has no intersection
  * with the nodes on the list. Remove nodes that may cause this.
@@ -164,6 +357,10 @@ filt_init(struct filt *o)
 	o->map = NULL;
 	o->vcurve = NULL;
 	o->transp = NULL;
+	o->maptail = &o->map;
+	o->cells = NULL;
+	o->mark = 0;
+	o->cmap = NULL;
 }
 
 /*
@@ -172,6 +369,8 @@ filt_init(struct filt *o)
 void
 filt_reset(struct filt *o)
 {
+	filt_touch(o);
+	filt_unindex(o);
 	while (o->map)
 		filtnode_del(&o->map);
 	while (o->transp)
@@ -213,6 +412,251 @@ vcurve(unsigned nweight, unsigned x)
 	}
 }
 
+/*
+ * return the table of velocities adjusted by the curve with the given
+ * weight, indexed by the velocity. Tables are built on first use and
+ * never freed
+ */
+unsigned char *
+vcurve_tab(unsigned nweight)
+{
+	static unsigned char tabs[128][128];
+	static unsigned char built[128];
+	unsigned char *tab;
+	unsigned x;
+
+	nweight &= 0x7f;
+	tab = tabs[nweight];
+	if (!built[nweight]) {
+		for (x = 0; x < 128; x++)
+			tab[x] = vcurve(nweight, x);
+		built[nweight] = 1;
+	}
+	return tab;
+}
+
+/*
+ * must be called before any change of the rules, frees the compiled
+ * rules; until filt_compile() is called again, filt_do() uses the
+ * rule lists
+ */
+void
+filt_touch(struct filt *o)
+{
+	if (o->cmap) {
+		xfree(o->cmap->chains);
+		xfree(o->cmap);
+		o->cmap = NULL;
+	}
+}
+
+/*
+ * return the key of the given event in the compiled rules table, or
+ * FILT_NKEYS if the event is not in the table
+ */
+unsigned
+filt_key(struct ev *ev)
+{
+	if (!EV_ISVOICE(ev) || ev->dev > EV_MAXDEV || ev->ch > EV_MAXCH)
+		return FILT_NKEYS;
+	return ((ev->cmd - EV_NRPN) * (EV_MAXDEV + 1) + ev->dev) *
+	    (EV_MAXCH + 1) + ev->ch;
+}
+
+/*
+ * get the range of keys of the compiled rules table containing
+ * events of the given set, return 0 if there are none
+ */
+unsigned
+filt_cmdrange(struct evspec *es, unsigned *cmin, unsigned *cmax)
+{
+	switch (es->cmd) {
+	case EVSPEC_EMPTY:
+		return 0;
+	case EVSPEC_ANY:
+		*cmin = EV_NRPN;
+		*cmax = EV_BEND;
+		break;
+	case EVSPEC_NOTE:
+		*cmin = EV_NOFF;
+		*cmax = EV_KAT;
+		break;
+	default:
+		*cmin = *cmax = es->cmd;
+	}
+	return 1;
+}
+
+/*
+ * make room for the given number of entries in the chains array
+ */
+void
+filt_chainalloc(struct filtmap *m, unsigned n)
+{
+	struct filtent *chains;
+	unsigned i;
+
+	if (m->maxchains >= n)
+		return;
+	while (m->maxchains < n)
+		m->maxchains *= 2;
+	chains = xmalloc(m->maxchains * sizeof(struct filtent),
+	    "filtchain");
+	for (i = 0; i < m->nchains; i++)
+		chains[i] = m->chains[i];
+	xfree(m->chains);
+	m->chains = chains;
+}
+
+/*
+ * for each key, build the list of rules that may match events with
+ * that key: count the rules of each key, store them, then remove
+ * lists that are the same as the one of the previous key
+ */
+void
+filt_compilelist(struct filtmap *m, struct filtnode *list, unsigned *idx)
+{
+	struct filtnode *s;
+	struct filtent *e, *p, *q;
+	unsigned *pos, key, cmd, dev, ch, n, start;
+	unsigned cmdmin, cmdmax, dmin, dmax, cmin, cmax;
+
+	for (key = 0; key < FILT_NKEYS; key++)
+		idx[key] = 0;
+	for (s = list; s != NULL; s = s->next) {
+		if (!filt_cmdrange(&s->es, &cmdmin, &cmdmax))
+			continue;
+		filt_cellrange(&s->es, &dmin, &dmax, &cmin, &cmax);
+		for (cmd = cmdmin; cmd <= cmdmax; cmd++) {
+			for (dev = dmin; dev <= dmax; dev++) {
+				key = ((cmd - EV_NRPN) * (EV_MAXDEV + 1) +
+				    dev) * (EV_MAXCH + 1) + cmin;
+				for (ch = cmin; ch <= cmax; ch++)
+					idx[key++]++;
+			}
+		}
+	}
+	start = m->nchains;
+	for (key = 0; key < FILT_NKEYS; key++) {
+		n = idx[key];
+		idx[key] = start;
+		start += n + 1;
+	}
+	filt_chainalloc(m, start);
+
+	pos = xmalloc(FILT_NKEYS * sizeof(unsigned), "filtpos");
+	for (key = 0; key < FILT_NKEYS; key++)
+		pos[key] = idx[key];
+	for (s = list; s != NULL; s = s->next) {
+		if (!filt_cmdrange(&s->es, &cmdmin, &cmdmax))
+			continue;
+		filt_cellrange(&s->es, &dmin, &dmax, &cmin, &cmax);
+		for (cmd = cmdmin; cmd <= cmdmax; cmd++) {
+			for (dev = dmin; dev <= dmax; dev++) {
+				key = ((cmd - EV_NRPN) * (EV_MAXDEV + 1) +
+				    dev) * (EV_MAXCH + 1) + cmin;
+				for (ch = cmin; ch <= cmax; ch++) {
+					e = m->chains + pos[key++]++;
+					e->node = s;
+					if (evinfo[s->es.cmd].nparams > 0) {
+						e->v0_min = s->es.v0_min;
+						e->v0_max = s->es.v0_max;
+					} else {
+						e->v0_min = 0;
+						e->v0_max = ~0U;
+					}
+				}
+			}
+		}
+	}
+	for (key = 0; key < FILT_NKEYS; key++)
+		m->chains[pos[key]].node = NULL;
+	xfree(pos);
+
+	/*
+	 * share lists of consecutive keys, moving lists to
+	 * fill the gaps
+	 */
+	start = m->nchains;
+	for (key = 0; key < FILT_NKEYS; key++) {
+		q = m->chains + idx[key];
+		if (key > 0) {
+			p = m->chains + idx[key - 1];
+			while (p->node == q->node && p->node != NULL) {
+				p++;
+				q++;
+			}
+			if (p->node == q->node) {
+				idx[key] = idx[key - 1];
+				continue;
+			}
+			q = m->chains + idx[key];
+		}
+		idx[key] = start;
+		p = m->chains + start;
+		for (;;) {
+			*p = *q;
+			start++;
+			if (p->node == NULL)
+				break;
+			p++;
+			q++;
+		}
+	}
+	m->nchains = start;
+}
+
+/*
+ * build the table of compiled rules; this allocates memory, so it's
+ * done when the song enters idle mode and after each change while
+ * it's running, never by filt_do()
+ */
+void
+filt_compile(struct filt *o)
+{
+	struct filtmap *m;
+
+	filt_touch(o);
+	m = xmalloc(sizeof(struct filtmap), "filtmap");
+	m->nchains = 0;
+	m->maxchains = 64;
+	m->chains = xmalloc(m->maxchains * sizeof(struct filtent),
+	    "filtchain");
+	filt_compilelist(m, o->map, m->map);
+	filt_compilelist(m, o->vcurve, m->vcurve);
+	filt_compilelist(m, o->transp, m->transp);
+	o->cmap = m;
+}
+
+/*
+ * return the first rule of the given list matching the given event,
+ * use the compiled list if there's one and the event has a key
+ */
+struct filtnode *
+filt_match(struct filtmap *m, struct filtnode *list, unsigned *idx,
+    struct ev *ev)
+{
+	struct filtent *e;
+	struct filtnode *s;
+	unsigned key;
+
+	key = filt_key(ev);
+	if (m != NULL && key < FILT_NKEYS) {
+		for (e = m->chains + idx[key]; (s = e->node) != NULL; e++) {
+			if (ev->v0 < e->v0_min || ev->v0 > e->v0_max)
+				continue;
+			if (evspec_matchev(&s->es, ev))
+				return s;
+		}
+		return NULL;
+	}
+	for (s = list; s != NULL; s = s->next) {
+		if (evspec_matchev(&s->es, ev))
+			return s;
+	}
+	return NULL;
+}
+
 /*
  * match event against all sources and for each source
  * generate output events
@@ -221,53 +665,48 @@ unsigned
 filt_do(struct filt *o, struct ev *in, struct ev *out)
 {
 	struct ev *ev;
+	struct filtmap *m;
 	struct filtnode *s;
 	struct filtnode *d;
 	unsigned nev, i;
 
+	m = o->cmap;
+	if (filt_debug) {
+		log_puts("filt_do: in = ");
+		ev_log(in);
+		log_puts("\n");
+	}
 	nev = 0;
-	for (s = o->map;; s = s->next) {
-		if (s == NULL)
-			break;
-		if (filt_debug) {
-			log_puts("filt_do: in = ");
-			ev_log(in);
-			log_puts("\n");
-		}
-		if (evspec_matchev(&s->es, in)) {
-			for (d = s->dstlist; d != NULL; d = d->next) {
-				if (d->es.cmd == EVSPEC_EMPTY)
-					continue;
-				ev_map(in, &s->es, &d->es, &out[nev]);
-				if (filt_debug) {
-					log_puts("filt_do: (");
-					rule_log(&s->es, &d->es);
-					log_puts("): ");
-					ev_log(in);
-					log_puts(" -> ");
-					ev_log(&out[nev]);
-					log_puts("\n");
-				}
-				nev++;
+	s = filt_match(m, o->map, m ? m->map : NULL, in);
+	if (s != NULL) {
+		for (d = s->dstlist; d != NULL; d = d->next) {
+			if (d->es.cmd == EVSPEC_EMPTY)
+				continue;
+			if (nev == FILT_MAXNOUT)
+				break;
+			ev_map(in, &s->es, &d->es, &out[nev]);
+			if (filt_debug) {
+				log_puts("filt_do: (");
+				rule_log(&s->es, &d->es);
+				log_puts("): ");
+				ev_log(in);
+				log_puts(" -> ");
+				ev_log(&out[nev]);
+				log_puts("\n");
 			}
-			break;
+			nev++;
 		}
 	}
 	if (!EV_ISNOTE(in))
 		return nev;
 	for (i = 0, ev = out; i < nev; i++, ev++) {
-		for (d = o->vcurve; d != NULL; d = d->next) {
-			if (!evspec_matchev(&d->es, ev))
-				continue;
-			ev->note_vel = vcurve(d->u.vel.nweight, ev->note_vel);
-			break;
-		}
-		for (d = o->transp; d != NULL; d = d->next) {
-			if (!evspec_matchev(&d->es, ev))
-				continue;
+		d = filt_match(m, o->vcurve, m ? m->vcurve : NULL, ev);
+		if (d != NULL)
+			ev->note_vel = d->u.vel.tab[ev->note_vel];
+		d = filt_match(m, o->transp, m ? m->transp : NULL, ev);
+		if (d != NULL) {
 			ev->note_num += d->u.transp.plus;
 			ev->note_num &= 0x7f;
-			break;
 		}
 	}
 	return nev;
@@ -282,6 +721,7 @@ filt_mapdel(struct filt *f, struct evspec *from, struct evspec *to)
 	struct filtnode *s, **ps;
 	struct filtnode *d, **pd;
 
+	filt_touch(f);
 	for (ps = &f->map; (s = *ps) != NULL;) {
 		if (evspec_in(&s->es, from)) {
 			for (pd = &s->dstlist; (d = *pd) != NULL;) {
@@ -303,7 +743,7 @@ filt_mapdel(struct filt *f, struct evspec *from, struct evspec *to)
 				evspec_log(&s->es);
 				log_puts(": empty, removed\n");
 			}
-			filtnode_del(ps);
+			filt_srcdel(f, ps);
 			continue;
 		}
 		ps = &s->next;
@@ -318,6 +758,7 @@ filt_mapnew(struct filt *f, struct evspec *from, struct evspec *to)
 {
 	struct filtnode *s;
 
+	filt_touch(f);
 	if (filt_debug) {
 		log_puts("filt_mapnew: adding ");
 		rule_log(from, to);
@@ -330,7 +771,7 @@ filt_mapnew(struct filt *f, struct evspec *from, struct evspec *to)
 	if (to->cmd != EVSPEC_EMPTY && !evspec_isamap(from, to))
 		return;
 
-	s = filtnode_mksrc(&f->map, from);
+	s = filt_mksrc(f, from);
 	filtnode_mkdst(s, to);
 }
 
@@ -339,6 +780,8 @@ filt_detach(struct filt *o)
 {
 	struct filtnode *list, *s;
 
+	filt_touch(o);
+	filt_unindex(o);
 	for (list = NULL; (s = o->map) != NULL;) {
 		o->map = s->next;
 		s->next = list;
@@ -424,6 +867,7 @@ filt_transp(struct filt *f, struct evspec *from, int plus)
 		return;
 	}
 
+	filt_touch(f);
 	s = filtnode_mksrc(&f->transp, from);
 	s->u.transp.plus = plus & 0x7f;
 }
@@ -437,8 +881,10 @@ filt_vcurve(struct filt *f, struct evspec *from, int weight)
 		log_puts("filt_vcurve: set must contain notes\n");
 		return;
 	}
+	filt_touch(f);
 	s = filtnode_mksrc(&f->vcurve, from);
 	s->u.vel.nweight = (64 - weight) & 0x7f;
+	s->u.vel.tab = vcurve_tab(s->u.vel.nweight);
 }
 
 unsigned
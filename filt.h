@@ -26,9 +26,12 @@ struct filtnode {
 	struct evspec es;		/* events handled by this branch */
 	struct filtnode *dstlist;	/* destinations for this source */
 	struct filtnode *next;		/* next source in the list */
+	struct filtnode **prev;		/* pointer to this node */
+	unsigned mark;			/* last lookup it was found by */
 	union {
 		struct {
 			unsigned nweight;
+			unsigned char *tab;	/* curve of nweight */
 		} vel;
 		struct {
 			int plus;
@@ -36,19 +39,66 @@ struct filtnode {
 	} u;
 };
 
-#define FILT_MAXNRULES 32
+/*
+ * max events generated by a single input event
+ */
+#define FILT_MAXNOUT 64
+
+/*
+ * index of map sources: for each device and channel, the array of
+ * sources that may contain events on it, in no particular order
+ */
+#define FILT_NCELLS ((EV_MAXDEV + 1) * (EV_MAXCH + 1))
+
+struct filtcell {
+	struct filtnode **srcs;
+	unsigned nsrcs, maxsrcs;
+};
+
+/*
+ * rules compiled into a table indexed by the command, the device
+ * and the channel of voice events. For each list of rules, the
+ * table gives the offset in the chains array of the NULL terminated
+ * list of rules that may match events with the given key, in the
+ * same order as the rules. The range of the first parameter is
+ * stored in the list, so most rules can be skipped without
+ * accessing them.
+ */
+#define FILT_NKEYS \
+	((EV_BEND - EV_NRPN + 1) * (EV_MAXDEV + 1) * (EV_MAXCH + 1))
+
+struct filtent {
+	unsigned v0_min, v0_max;	/* range of the first param */
+	struct filtnode *node;		/* rule, NULL at the end */
+};
+
+struct filtmap {
+	unsigned map[FILT_NKEYS];	/* map rules per key */
+	unsigned vcurve[FILT_NKEYS];	/* vcurve rules per key */
+	unsigned transp[FILT_NKEYS];	/* transp rules per key */
+	struct filtent *chains;		/* lists of rules */
+	unsigned nchains, maxchains;	/* used and allocated entries */
+};
 
 struct filt {
 	struct filtnode *map;		/* root of map rules */
 	struct filtnode *vcurve;	/* root of vcurve rules */
 	struct filtnode *transp;	/* root of transp rules */
+	struct filtnode **maptail;	/* end of map rules, if indexed */
+	struct filtcell *cells;		/* index of map sources, or NULL */
+	unsigned mark;			/* current lookup */
+	struct filtmap *cmap;		/* compiled rules, or NULL */
 };
 
 unsigned vcurve(unsigned, unsigned);
+unsigned char *vcurve_tab(unsigned);
 
 void filt_init(struct filt *);
 void filt_done(struct filt *);
 void filt_reset(struct filt *);
+void filt_touch(struct filt *);
+void filt_compile(struct filt *);
+void filt_index(struct filt *);
 unsigned filt_do(struct filt *, struct ev *, struct ev *);
 void filt_mapnew(struct filt *, struct evspec *, struct  evspec *);
 void filt_mapdel(struct filt *, struct evspec *, struct  evspec *);
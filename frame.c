@@ -148,6 +148,7 @@
  *	  the same as the event we write
  */
 
+#include <string.h>
 #include "utils.h"
 #include "track.h"
 #include "defs.h"
@@ -181,6 +182,7 @@ seqptr_new(struct track *t)
 	sp = (struct seqptr *)pool_new(&seqptr_pool);
 	statelist_init(&sp->statelist);
 	sp->link = NULL;
+	sp->track = t;
 	sp->pos = t->first;
 	sp->delta = 0;
 	sp->tic = 0;
@@ -261,6 +263,7 @@ seqptr_evdel(struct seqptr *sp, struct statelist *slist)
 	if (sp->delta != sp->pos->delta || sp->pos->ev.cmd == EV_NULL) {
 		return NULL;
 	}
+	track_touchat(sp->track, sp->tic);
 	if (slist)
 		st = statelist_update(slist, &sp->pos->ev);
 	else
@@ -286,7 +289,8 @@ seqptr_evput(struct seqptr *sp, struct ev *ev)
 	struct seqptr *link;
 	struct seqev *se;
 
-	se = seqev_new();
+	track_touchat(sp->track, sp->tic);
+	se = seqev_new(sp->track);
 	se->ev = *ev;
 	se->delta = sp->delta;
 	sp->pos->delta -= sp->delta;
@@ -343,6 +347,8 @@ seqptr_ticdel(struct seqptr *sp, unsigned max, struct statelist *slist)
 	if (ntics > max) {
 		ntics = max;
 	}
+	if (ntics > 0)
+		track_touchat(sp->track, sp->tic);
 	sp->pos->delta -= ntics;
 	if (slist != NULL && max > 0) {
 		statelist_outdate(slist);
@@ -369,6 +375,7 @@ seqptr_ticput(struct seqptr *sp, unsigned ntics)
 	if (ntics == 0)
 		return;
 
+	track_touchat(sp->track, sp->tic);
 	sp->pos->delta += ntics;
 	sp->delta += ntics;
 	sp->tic += ntics;
@@ -417,6 +424,112 @@ seqptr_seek(struct seqptr *sp, unsigned ntics)
 		seqptr_ticput(sp, ntics);
 }
 
+/*
+ * store the current position and state list as a new checkpoint of
+ * the track seek index
+ */
+void
+seqptr_ckptadd(struct seqptr *sp, struct track_idx *idx)
+{
+	struct track_ckpt *c, *ckpts;
+	struct state *s;
+	unsigned n;
+
+	if (idx->n == idx->size) {
+		idx->size = idx->size ? 2 * idx->size : 16;
+		ckpts = xmalloc(idx->size * sizeof(struct track_ckpt),
+		    "track_ckpt");
+		for (n = 0; n < idx->n; n++)
+			ckpts[n] = idx->ckpts[n];
+		if (idx->ckpts)
+			xfree(idx->ckpts);
+		idx->ckpts = ckpts;
+	}
+	c = &idx->ckpts[idx->n++];
+	c->pos = sp->pos;
+	c->delta = sp->delta;
+	c->nstates = 0;
+	for (s = sp->statelist.first; s != NULL; s = s->next)
+		c->nstates++;
+	if (c->nstates == 0) {
+		c->states = NULL;
+		return;
+	}
+	c->states = xmalloc(c->nstates * sizeof(struct state), "track_ckst");
+	n = 0;
+	for (s = sp->statelist.first; s != NULL; s = s->next)
+		c->states[n++] = *s;
+}
+
+/*
+ * restore the position and the state list from the given checkpoint;
+ * states are added in reverse order, so the list has the same order
+ * as if the track was read
+ */
+void
+seqptr_ckptget(struct seqptr *sp, struct track_ckpt *c, unsigned tic)
+{
+	struct state *s;
+	unsigned n;
+
+	statelist_empty(&sp->statelist);
+	sp->statelist.changed = 0;
+	for (n = c->nstates; n > 0; n--) {
+		s = state_new();
+		*s = c->states[n - 1];
+		statelist_add(&sp->statelist, s);
+	}
+	sp->pos = c->pos;
+	sp->delta = c->delta;
+	sp->tic = tic;
+}
+
+/*
+ * same as seqptr_skip() but must be called on a seqptr at the
+ * beginning of the track. Instead of reading the whole track, start
+ * from the nearest checkpoint of the seek index, which is built as
+ * we move forward
+ */
+unsigned
+seqptr_locate(struct seqptr *sp, unsigned ntics)
+{
+	struct track *t = sp->track;
+	struct track_idx *idx;
+	unsigned n;
+
+	if (sp->tic != 0 || sp->pos != t->first || sp->delta != 0 ||
+	    sp->link != NULL) {
+		log_puts("seqptr_locate: not at the beginning of the track\n");
+		panic();
+	}
+	if (t->idx == NULL) {
+		t->idx = xmalloc(sizeof(struct track_idx), "track_idx");
+		t->idx->n = t->idx->size = 0;
+		t->idx->ckpts = NULL;
+	}
+	idx = t->idx;
+
+	/*
+	 * jump to the last checkpoint before the given position
+	 */
+	n = ntics / TRACK_IDXTICS;
+	if (n > idx->n)
+		n = idx->n;
+	if (n > 0)
+		seqptr_ckptget(sp, &idx->ckpts[n - 1], n * TRACK_IDXTICS);
+
+	/*
+	 * add missing checkpoints, if we reach the end of the track
+	 * there are no more checkpoints to add
+	 */
+	while (idx->n < ntics / TRACK_IDXTICS) {
+		if (seqptr_skip(sp, TRACK_IDXTICS) > 0)
+			return ntics - sp->tic;
+		seqptr_ckptadd(sp, idx);
+	}
+	return seqptr_skip(sp, ntics - sp->tic);
+}
+
 
 /*
  * move the next frame of the current tick to the given track. Must
@@ -437,6 +550,7 @@ seqptr_framerm(struct seqptr *sp, struct track *f)
 		panic();
 	}
 
+	track_touchat(sp->track, sp->tic);
 	track_clear(f);
 	fpos = f->first;
 
@@ -512,6 +626,9 @@ seqptr_frameadd(struct seqptr *sp, struct track *f)
 	struct seqev *se, *spos, **save_pos;
 	unsigned ntics, offs, sdelta, save_delta;
 
+	track_touchat(sp->track, sp->tic);
+	track_touch(f);
+
 	/*
 	 * Save current postition.
 	 */
@@ -653,6 +770,7 @@ seqptr_rmlast(struct seqptr *sp, struct state **pst)
 	 * remove the event from the track
 	 * (but not the blank space)
 	 */
+	track_touchat(sp->track, st->tic);
 	next = cur->next;
 	next->delta += cur->delta;
 	if (next == sp->pos) {
@@ -696,6 +814,7 @@ seqptr_rmprev(struct seqptr *sp, struct state **pst)
 	 * start a the first event of the frame and iterate until the
 	 * current postion removing all events of the frame.
 	 */
+	track_touchat(sp->track, st->tic);
 	i = st->pos;
 	for (;;) {
 		if (state_match(st, &i->ev)) {
@@ -1514,9 +1633,10 @@ track_vcurve(struct track *src, unsigned start, unsigned len,
 	struct state *st;
 	struct statelist slist;
 	struct ev ev;
+	unsigned char *tab;
 
 	/* put weight from -63:63 to 1:127 range */
-	weight = (64 - weight) & 0x7f;
+	tab = vcurve_tab((64 - weight) & 0x7f);
 
 	sp = seqptr_new(src);
 	statelist_dup(&slist, &sp->statelist);
@@ -1536,7 +1656,7 @@ track_vcurve(struct track *src, unsigned start, unsigned len,
 		    tic >= start && tic < start + len &&
 		    EV_ISNOTE(&st->ev) && state_inspec(st, es)) {
 			ev = st->ev;
-			ev.note_vel = vcurve(weight, ev.note_vel);
+			ev.note_vel = tab[ev.note_vel];
 			seqptr_evput(sp, &ev);
 		} else {
 			seqptr_evput(sp, &st->ev);
@@ -1728,6 +1848,91 @@ seqptr_skipmeasure(struct seqptr *sp, unsigned meas)
 	return 0;
 }
 
+/*
+ * return the tempo map of the given track, build it if needed
+ */
+struct track_tmap *
+track_gettmap(struct track *t)
+{
+	struct track_tmap *tm;
+	struct track_tment *e, *p, *ents;
+	struct seqptr *sp;
+	unsigned size, bpm, tpb, curlen, k;
+	unsigned long usec24;
+
+	if (t->tmap)
+		return t->tmap;
+
+	tm = xmalloc(sizeof(struct track_tmap), "track_tmap");
+	size = 16;
+	tm->ents = xmalloc(size * sizeof(struct track_tment), "track_tment");
+	tm->n = 0;
+	curlen = 0;
+	sp = seqptr_new(t);
+	for (;;) {
+		while (seqptr_evget(sp))
+			; /* nothing */
+		seqptr_getsign(sp, &bpm, &tpb);
+		seqptr_gettempo(sp, &usec24);
+		p = (tm->n > 0) ? &tm->ents[tm->n - 1] : NULL;
+		if (p == NULL || p->bpm != bpm || p->tpb != tpb ||
+		    p->usec24 != usec24) {
+			if (tm->n == size) {
+				size *= 2;
+				ents = xmalloc(size *
+				    sizeof(struct track_tment), "track_tment");
+				memcpy(ents, tm->ents,
+				    tm->n * sizeof(struct track_tment));
+				xfree(tm->ents);
+				tm->ents = ents;
+				p = &tm->ents[tm->n - 1];
+			}
+			e = &tm->ents[tm->n++];
+			e->tic = sp->tic;
+			e->bpm = bpm;
+			e->tpb = tpb;
+			e->usec24 = usec24;
+			e->mlen = bpm * tpb;
+			if (p == NULL) {
+				e->meas = e->mtic = 0;
+				e->time = 0;
+			} else {
+				e->time = p->time +
+				    (unsigned long long)(e->tic - p->tic) *
+				    p->usec24;
+				if (e->tic <= p->mtic) {
+					/*
+					 * in the same measure as the
+					 * previous entry
+					 */
+					e->meas = p->meas;
+					e->mtic = p->mtic;
+				} else {
+					k = (e->tic - p->mtic + p->mlen - 1) /
+					    p->mlen;
+					e->meas = p->meas + k;
+					e->mtic = p->mtic + k * p->mlen;
+					curlen = p->mlen;
+				}
+			}
+		}
+		if (seqptr_ticskip(sp, ~0U) == 0)
+			break;
+	}
+
+	/*
+	 * measures after the end of the track have the length of
+	 * the last measure read, even if the time signature changed
+	 * in the middle of it
+	 */
+	e = &tm->ents[tm->n - 1];
+	if (e->mtic > e->tic && sp->tic < e->mtic)
+		e->mlen = curlen;
+	seqptr_del(sp);
+	t->tmap = tm;
+	return tm;
+}
+
 /*
  * convert a measure number to a tic number using
  * meta-events from the given track
@@ -1735,13 +1940,25 @@ seqptr_skipmeasure(struct seqptr *sp, unsigned meas)
 unsigned
 track_findmeasure(struct track *t, unsigned m)
 {
-	struct seqptr *sp;
-	unsigned tic;
+	struct track_tmap *tm;
+	struct track_tment *e;
+	unsigned lo, hi, mid, tic;
 
-	sp = seqptr_new(t);
-	tic  = seqptr_skipmeasure(sp, m);
-	tic += sp->tic;
-	seqptr_del(sp);
+	/*
+	 * find the last entry starting at or before the measure
+	 */
+	tm = track_gettmap(t);
+	lo = 0;
+	hi = tm->n;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (tm->ents[mid].meas <= m)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	e = &tm->ents[lo];
+	tic = e->mtic + (m - e->meas) * e->mlen;
 
 #ifdef FRAME_DEBUG
 	log_puts("track_findmeasure: ");
@@ -1754,6 +1971,28 @@ track_findmeasure(struct track *t, unsigned m)
 	return tic;
 }
 
+/*
+ * return the tempo map entry in effect at the given tic
+ */
+struct track_tment *
+track_tmfind(struct track *t, unsigned tic)
+{
+	struct track_tmap *tm;
+	unsigned lo, hi, mid;
+
+	tm = track_gettmap(t);
+	lo = 0;
+	hi = tm->n;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (tm->ents[mid].tic <= tic)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return &tm->ents[lo];
+}
+
 /*
  * return the absolute tic, the tempo and the time signature
  * corresponding to the given measure number
@@ -1762,26 +2001,93 @@ void
 track_timeinfo(struct track *t, unsigned meas, unsigned *abs,
     unsigned long *usec24, unsigned *bpm, unsigned *tpb)
 {
-	struct seqptr *sp;
+	struct track_tment *e;
 	unsigned tic;
 
-	sp = seqptr_new(t);
-	tic  = seqptr_skipmeasure(sp, meas);
-	tic += sp->tic;
+	tic = track_findmeasure(t, meas);
+	e = track_tmfind(t, tic);
+	if (abs)
+		*abs = tic;
+	if (usec24)
+		*usec24 = e->usec24;
+	if (bpm)
+		*bpm = e->bpm;
+	if (tpb)
+		*tpb = e->tpb;
+}
+
+/*
+ * return the time (in 24-th of microsecond) of the given tic
+ */
+unsigned long long
+track_tictime(struct track *t, unsigned tic)
+{
+	struct track_tment *e;
+
+	e = track_tmfind(t, tic);
+	return e->time + (unsigned long long)(tic - e->tic) * e->usec24;
+}
+
+/*
+ * convert an absolute tic number to a measure, beat, tic triplet
+ */
+void
+track_findtic(struct track *t, unsigned tic,
+    unsigned *rmeas, unsigned *rbeat, unsigned *rtic)
+{
+	struct track_tmap *tm;
+	struct track_tment *e;
+	unsigned lo, hi, mid, k, rem;
 
 	/*
-	 * move to the last event, so all meta events enter the
-	 * state list
+	 * find the last entry with a measure starting at or before
+	 * the given tic
 	 */
-	while (seqptr_evget(sp)) {
-		/* nothing */
-	}
-	if (abs) {
-		*abs = tic;
-	}
-	seqptr_getsign(sp, bpm, tpb);
-	seqptr_gettempo(sp, usec24);
-	seqptr_del(sp);
+	tm = track_gettmap(t);
+	lo = 0;
+	hi = tm->n;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (tm->ents[mid].mtic <= tic)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	e = &tm->ents[lo];
+	k = (tic - e->mtic) / e->mlen;
+	rem = tic - e->mtic - k * e->mlen;
+	*rmeas = e->meas + k;
+	*rbeat = rem / e->tpb;
+	*rtic = rem % e->tpb;
+}
+
+/*
+ * convert a time (in 24-th of microsecond) to the absolute tic
+ * number just before it. The time of the returned tic is stored
+ * in 'rtime'
+ */
+unsigned
+track_findtime(struct track *t, unsigned long long time,
+    unsigned long long *rtime)
+{
+	struct track_tmap *tm;
+	struct track_tment *e;
+	unsigned lo, hi, mid, tic;
+
+	tm = track_gettmap(t);
+	lo = 0;
+	hi = tm->n;
+	while (hi - lo > 1) {
+		mid = (lo + hi) / 2;
+		if (tm->ents[mid].time <= time)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	e = &tm->ents[lo];
+	tic = e->tic + (time - e->time) / e->usec24;
+	*rtime = e->time + (unsigned long long)(tic - e->tic) * e->usec24;
+	return tic;
 }
 
 /*
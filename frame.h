@@ -19,15 +19,17 @@
 
 #include "state.h"
 
+struct track;
+
 struct seqptr {
 	struct statelist statelist;
 	struct seqptr *link;		/* opposite direction seqptr */
+	struct track *track;		/* track we're on */
 	struct seqev *pos;		/* next event (current position) */
 	unsigned delta;			/* tics until the next event */
 	unsigned tic;			/* absolute tic of the current pos */
 };
 
-struct track;
 struct evspec;
 
 void	      seqptr_pool_init(unsigned);
@@ -45,6 +47,7 @@ unsigned      seqptr_ticdel(struct seqptr *, unsigned,
 void	      seqptr_ticput(struct seqptr *, unsigned);
 unsigned      seqptr_skip(struct seqptr *, unsigned);
 void	      seqptr_seek(struct seqptr *, unsigned);
+unsigned      seqptr_locate(struct seqptr *, unsigned);
 struct state *seqptr_getsign(struct seqptr *, unsigned *, unsigned *);
 struct state *seqptr_gettempo(struct seqptr *, unsigned long *);
 unsigned      seqptr_skipmeasure(struct seqptr *, unsigned);
@@ -56,6 +59,11 @@ void	 track_merge(struct track *, struct track *);
 unsigned track_findmeasure(struct track *, unsigned);
 void	 track_timeinfo(struct track *, unsigned, unsigned *,
 			unsigned long *, unsigned *, unsigned *);
+void	 track_findtic(struct track *, unsigned,
+			unsigned *, unsigned *, unsigned *);
+unsigned track_findtime(struct track *, unsigned long long,
+			unsigned long long *);
+unsigned long long track_tictime(struct track *, unsigned);
 void     track_settempo(struct track *, unsigned, unsigned);
 void     track_move(struct track *, unsigned, unsigned,
 		    struct evspec *, struct track *,
@@ -712,6 +712,14 @@ struct help help_list[] = {
 	"Save the song into the given standard MIDI file. The file name "
 	"is a quoted string."},
 
+	{"render",
+	"render filename\n"
+	"\n"
+	"Play the song from the current position to its end as fast as "
+	"possible, and save what would be sent to the MIDI devices into "
+	"the given standard MIDI file. Filters, channel configurations "
+	"and the metronome are applied."},
+
 	{"import",
 	"import filename\n"
 	"\n"
@@ -749,7 +757,13 @@ struct help help_list[] = {
 	"If nil is given instead of the path, then the port is not "
 	"connected to any existing port}, this allows other ALSA sequencer "
 	"clients to subscribe to it and to provide events to midish or to "
-	"consume events midish sends to the port."},
+	"consume events midish sends to the port.\n"
+	"\n"
+	"If the path starts with \"loop:\", a loop device is created: "
+	"it doesn't use any hardware, its input is given with dinject "
+	"and its output is discarded or written in the file whose name "
+	"follows \"loop:\", one line per write, with a time-stamp in "
+	"microseconds."},
 
 	{"ddel",
 	"ddel devnum\n"
@@ -797,6 +811,67 @@ struct help help_list[] = {
 	"MIDI device. Default value is 96 ticks. This is the standard MIDI "
 	"value and its not recommended to change it."},
 
+	{"tickless",
+	"tickless flag\n"
+	"\n"
+	"If the flag is true, don't use a periodic timer, instead sleep "
+	"until the next tick or timeout is due. This avoids waking up "
+	"when there's nothing to do. Default is false."},
+
+	{"dothread",
+	"dothread devnum flag\n"
+	"\n"
+	"If the flag is true, write to the given device from a separate "
+	"real-time thread, so a slow device can't delay the clock. "
+	"If the device can't keep up, it's closed as on write errors. Not "
+	"supported by ALSA and sndio devices. Default is false."},
+
+	{"dinject",
+	"dinject devnum data\n"
+	"\n"
+	"Inject the given list of bytes in the given loop device, as if "
+	"they were received from a MIDI port."},
+
+	{"lookahead",
+	"lookahead msec\n"
+	"\n"
+	"During playback, schedule the output of tracks the given number "
+	"of milliseconds ahead, so ALSA delivers it on time even if midish "
+	"wakes up late. Input is still handled in real time. Default is 0, "
+	"i.e. disabled."},
+
+	{"lowlat",
+	"lowlat flag\n"
+	"\n"
+	"If the flag is true, send each input event to the output as soon "
+	"as it's processed, rather than once the whole block of input "
+	"data received from the device is processed. This costs one write "
+	"per event. Default is false."},
+
+	{"rtstat",
+	"rtstat\n"
+	"\n"
+	"Print and reset histograms of the time between timer wakeups, of "
+	"how late ticks are processed and of how long it takes to process "
+	"input, in microseconds. Then print the number of timer wakeups "
+	"and of timeouts run during the last second."},
+
+	{"meminfo",
+	"meminfo\n"
+	"\n"
+	"Print the current and peak memory usage: bytes allocated per "
+	"allocation tag, usage of the event, state, sysex and other pools, "
+	"events and bytes used by each track, and bytes used by each "
+	"undo-able operation."},
+
+	{"poolshrink",
+	"poolshrink flag\n"
+	"\n"
+	"If the flag is true, free memory of pools that is no longer used, "
+	"keeping at least the initial size. If false, pools never shrink, "
+	"which avoids allocating memory again after a peak. Default is "
+	"true."},
+
 	{"dinfo",
 	"dinfo devnum\n"
 	"\n"
@@ -915,6 +990,18 @@ struct help help_list[] = {
 	"Set events set used to trigger start when tap mode is set to "
 	"start or tempo."},
 
+	{"thin",
+	"thin evspec msec delta smooth\n"
+	"\n"
+	"Thin input controllers, bender or channel aftertouch events in the "
+	"given set: a new value is passed only if at least msec milliseconds "
+	"elapsed and if it changed by at least delta since the last value "
+	"passed. The value is in the same unit as in tracks, for instance "
+	"0..16383 for controllers. If smooth is not zero, it is the "
+	"percentage of the previous value mixed in the new one. The last "
+	"value is always passed once the events stop. If all parameters "
+	"are zero, thinning is disabled for the set."},
+
 	{"info",
 	"info\n"
 	"\n"
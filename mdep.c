@@ -18,6 +18,11 @@
  * machine and OS dependent code
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE	/* for ppoll(2) */
+#define USE_EPOLL
+#endif
+
 #include <sys/param.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -26,6 +31,9 @@
 #ifdef __APPLE__
 #include <mach/mach_time.h>
 #endif
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
 #include <fcntl.h>
 #include <unistd.h>
 #include <poll.h>
@@ -45,6 +53,12 @@
 #include "exec.h"
 #include "tty.h"
 #include "utils.h"
+#include "rtstat.h"
+#include "pool.h"
+#include "track.h"
+#include "filt.h"
+#include "undo.h"
+#include "othread.h"
 
 #define TIMER_USEC	1000
 
@@ -59,11 +73,24 @@
 #define MIDI_BUFSIZE	1024
 #define MAXFDS		(DEFAULT_MAXNDEVS + 1)
 
+/*
+ * max number of reads from a device before going back to poll(), so
+ * that a device flooding us doesn't stop the clock
+ */
+#define MIDI_MAXREAD	64
+
 volatile sig_atomic_t cons_quit = 0, resize_flag = 0, cont_flag = 0;
-struct timespec ts, ts_last;
+struct timespec ts, ts_last, ts_wake;
 
 int cons_eof, cons_isatty;
 
+#ifdef USE_EPOLL
+/*
+ * epoll(7) descriptor with the fds of all open input devices
+ */
+int mdep_epfd = -1;
+#endif
+
 #if defined(__APPLE__) && !defined(CLOCK_MONOTONIC)
 #define CLOCK_MONOTONIC 0
 
@@ -82,6 +109,26 @@ clock_gettime(int which, struct timespec *ts)
 }
 #endif
 
+#ifdef __APPLE__
+/*
+ * there's no ppoll(2), use poll(2) with the timeout rounded up to
+ * the next millisecond
+ */
+int
+ppoll(struct pollfd *pfds, nfds_t nfds, struct timespec *timeout,
+    sigset_t *sigmask)
+{
+	int msec;
+
+	if (timeout == NULL)
+		msec = -1;
+	else
+		msec = timeout->tv_sec * 1000 +
+		    (timeout->tv_nsec + 999999) / 1000000;
+	return poll(pfds, nfds, msec);
+}
+#endif
+
 /*
  * handler for SIGALRM, invoked periodically
  */
@@ -123,6 +170,12 @@ mux_mdep_open(void)
 		log_perror("mux_mdep_open: clock_gettime");
 		exit(1);
 	}
+	/*
+	 * in tickless mode, mux_mdep_wait() sleeps until the
+	 * next deadline, so there's no need for a periodic timer
+	 */
+	if (mux_tickless)
+		return;
         sa.sa_flags = SA_RESTART;
         sa.sa_handler = mdep_sigalrm;
         sigfillset(&sa.sa_mask);
@@ -148,6 +201,14 @@ mux_mdep_close(void)
 {
 	struct itimerval it;
 
+#ifdef USE_EPOLL
+	if (mdep_epfd >= 0) {
+		(void)close(mdep_epfd);
+		mdep_epfd = -1;
+	}
+#endif
+	if (mux_tickless)
+		return;
 	it.it_value.tv_sec = 0;
 	it.it_value.tv_usec = 0;
 	it.it_interval.tv_sec = 0;
@@ -158,6 +219,196 @@ mux_mdep_close(void)
 	}
 }
 
+/*
+ * register the descriptors of the given device, must be called
+ * just after the device is opened. Input devices are added to the
+ * epoll(7) interest set, so we don't need to rebuild the array of
+ * pollfd structures each time we wait for input
+ */
+void
+mux_mdep_add(struct mididev *dev)
+{
+#ifdef USE_EPOLL
+	struct epoll_event ev;
+	unsigned i, nfds;
+
+	if (!(dev->mode & MIDIDEV_MODE_IN) || dev->eof)
+		return;
+	if (mdep_epfd < 0) {
+		mdep_epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (mdep_epfd < 0) {
+			log_perror("mux_mdep_add: epoll_create1");
+			exit(1);
+		}
+	}
+	dev->pfd = xmalloc(dev->ops->nfds(dev) * sizeof(struct pollfd),
+	    "pollfd");
+	nfds = dev->ops->pollfd(dev, dev->pfd, POLLIN);
+	for (i = 0; i < nfds; i++) {
+		ev.events = EPOLLIN;
+		ev.data.ptr = dev;
+		if (epoll_ctl(mdep_epfd, EPOLL_CTL_ADD,
+			dev->pfd[i].fd, &ev) < 0) {
+			log_perror("mux_mdep_add: epoll_ctl");
+			exit(1);
+		}
+	}
+#endif
+}
+
+/*
+ * unregister the descriptors of the given device, must be called
+ * before the device is closed. It's OK to call it more than once
+ */
+void
+mux_mdep_del(struct mididev *dev)
+{
+#ifdef USE_EPOLL
+	unsigned i, nfds;
+
+	if (dev->pfd == NULL)
+		return;
+	nfds = dev->ops->nfds(dev);
+	for (i = 0; i < nfds; i++) {
+		if (epoll_ctl(mdep_epfd, EPOLL_CTL_DEL,
+			dev->pfd[i].fd, NULL) < 0) {
+			log_perror("mux_mdep_del: epoll_ctl");
+			exit(1);
+		}
+	}
+	xfree(dev->pfd);
+	dev->pfd = NULL;
+#endif
+}
+
+/*
+ * account the time elapsed since we woke up, ie. the time it took
+ * to process input and to send the resulting output
+ */
+void
+mux_mdep_inputstat(void)
+{
+	struct timespec now;
+	long long nsec;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &now) < 0) {
+		log_perror("mux_mdep_inputstat: clock_gettime");
+		panic();
+	}
+	nsec = 1000000000LL * (now.tv_sec - ts_wake.tv_sec);
+	nsec += now.tv_nsec - ts_wake.tv_nsec;
+	if (nsec >= 0)
+		rtstat_add(&rtstat_input, nsec / 1000);
+}
+
+/*
+ * process input of the given device, given the poll(2) events
+ * returned by the revents() method. Read the device until there's
+ * nothing left to read (or MIDI_MAXREAD buffers were read), so
+ * bursts are processed before we go back to sleep.
+ */
+void
+mux_mdep_read(struct mididev *dev, int revents)
+{
+	unsigned char midibuf[MIDI_BUFSIZE];
+	unsigned n, count;
+
+	for (n = 0; ; n++) {
+		if (revents & POLLIN) {
+			count = dev->ops->read(dev, midibuf, MIDI_BUFSIZE);
+			if (dev->eof) {
+				mux_errorcb(dev->unit);
+				return;
+			}
+			mididev_inputcb(dev, midibuf, count);
+			mux_mdep_inputstat();
+		}
+		if (revents & POLLHUP) {
+			dev->eof = 1;
+			mux_errorcb(dev->unit);
+			return;
+		}
+		if (!(revents & POLLIN) || n == MIDI_MAXREAD)
+			break;
+
+		/*
+		 * check, without blocking, if there's more to read
+		 */
+		if (poll(dev->pfd, dev->ops->nfds(dev), 0) <= 0)
+			break;
+		revents = dev->ops->revents(dev, dev->pfd);
+	}
+}
+
+/*
+ * in tickless mode, calculate the poll(2) timeout to wake up at
+ * the next deadline of the mux, and return a pointer to it. Return
+ * NULL if we can sleep until the next input event.
+ */
+struct timespec *
+mux_mdep_timeout(struct timespec *timeout)
+{
+	struct timespec now, deadline;
+	unsigned long delta;
+	long long nsec;
+
+	if (!mux_isopen || !mux_tickless || !mux_nexttimo(&delta))
+		return NULL;
+
+	/*
+	 * the mux is up to date at ts_last, so the deadline is
+	 * relative to it. Round up to the next nanosecond to
+	 * avoid waking up too early
+	 */
+	nsec = (1000LL * delta + 23) / 24;
+	deadline.tv_sec = ts_last.tv_sec + nsec / 1000000000LL;
+	deadline.tv_nsec = ts_last.tv_nsec + nsec % 1000000000LL;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	if (clock_gettime(CLOCK_MONOTONIC, &now) < 0) {
+		log_perror("mux_mdep_timeout: clock_gettime");
+		panic();
+	}
+	nsec = 1000000000LL * (deadline.tv_sec - now.tv_sec);
+	nsec += deadline.tv_nsec - now.tv_nsec;
+	if (nsec < 0)
+		nsec = 0;
+	timeout->tv_sec = nsec / 1000000000LL;
+	timeout->tv_nsec = nsec % 1000000000LL;
+	return timeout;
+}
+
+/*
+ * output threads don't log nor touch the device structures, so
+ * report their errors on their behalf. ENOBUFS means the device
+ * couldn't keep up with our output
+ */
+void
+mux_mdep_othrcheck(void)
+{
+	struct mididev *dev;
+	int err;
+
+	for (dev = mididev_list; dev != NULL; dev = dev->next) {
+		if (dev->othr == NULL || dev->eof)
+			continue;
+		err = othread_geterr(dev->othr);
+		if (err != 0) {
+			log_puts("dev ");
+			log_putu(dev->unit);
+			log_puts(": ");
+			log_puts(err == ENOBUFS ?
+			    "output too slow" : strerror(err));
+			log_puts("\n");
+			dev->eof = 1;
+			mux_mdep_del(dev);
+			mux_errorcb(dev->unit);
+		}
+	}
+}
+
 /*
  * wait until an input device becomes readable or
  * until the next clock tick. Then process all events.
@@ -168,11 +419,20 @@ mux_mdep_wait(int docons)
 {
 	int i, res, revents;
 	nfds_t nfds;
-	struct pollfd *pfd, *tty_pfds, pfds[MAXFDS];
+	struct pollfd *tty_pfds, pfds[MAXFDS];
 	struct mididev *dev;
 	unsigned char midibuf[MIDI_BUFSIZE];
+	struct timespec timeout;
 	long long delta_nsec;
+#ifdef USE_EPOLL
+	struct pollfd *epoll_pfd;
+	struct epoll_event evs[MAXFDS];
+	int nev;
+#else
+	struct pollfd *pfd;
+#endif
 
+	mux_mdep_othrcheck();
 	nfds = 0;
 	if (docons && !cons_eof) {
 		tty_pfds = &pfds[nfds];		
@@ -185,6 +445,15 @@ mux_mdep_wait(int docons)
 		}
 	} else
 		tty_pfds = NULL;
+#ifdef USE_EPOLL
+	if (mdep_epfd >= 0) {
+		epoll_pfd = &pfds[nfds];
+		epoll_pfd->fd = mdep_epfd;
+		epoll_pfd->events = POLLIN;
+		nfds++;
+	} else
+		epoll_pfd = NULL;
+#else
 	for (dev = mididev_list; dev != NULL; dev = dev->next) {
 		if (!(dev->mode & MIDIDEV_MODE_IN) || dev->eof) {
 			dev->pfd = NULL;
@@ -194,6 +463,7 @@ mux_mdep_wait(int docons)
 		nfds += dev->ops->pollfd(dev, pfd, POLLIN);
 		dev->pfd = pfd;
 	}
+#endif
 	if (cons_quit) {
 		fprintf(stderr, "\n--interrupt--\n");
 		cons_quit = 0;
@@ -211,34 +481,56 @@ mux_mdep_wait(int docons)
 		if (cons_isatty)
 			tty_reset();
 	}
-	res = poll(pfds, nfds, -1);
+	/*
+	 * we're about to sleep, so it's a good time to call malloc().
+	 * Writing the undo journal may block on the disk, so it's
+	 * done only when the song is stopped
+	 */
+	pool_refill();
+	seqev_pool_refill();
+	if (!mux_isopen)
+		undo_flush();
+	res = ppoll(pfds, nfds, mux_mdep_timeout(&timeout), NULL);
 	if (res < 0 && errno != EINTR) {
-		log_perror("mux_mdep_wait: poll");
+		log_perror("mux_mdep_wait: ppoll");
 		exit(1);
 	}
+	if (res > 0 && clock_gettime(CLOCK_MONOTONIC, &ts_wake) < 0) {
+		log_perror("mux_mdep_wait: clock_gettime");
+		panic();
+	}
+#ifdef USE_EPOLL
+	if (res > 0 && epoll_pfd && (epoll_pfd->revents & POLLIN)) {
+		nev = epoll_wait(mdep_epfd, evs, MAXFDS, 0);
+		if (nev < 0 && errno != EINTR) {
+			log_perror("mux_mdep_wait: epoll_wait");
+			exit(1);
+		}
+		for (i = 0; i < nev; i++) {
+			dev = evs[i].data.ptr;
+			if (dev->eof)
+				continue;
+			if (dev->ops->nfds(dev) == 1) {
+				/*
+				 * EPOLLIN and EPOLLHUP match poll(2) bits
+				 */
+				dev->pfd->revents = evs[i].events;
+			} else if (poll(dev->pfd, dev->ops->nfds(dev), 0) <= 0)
+				continue;
+			mux_mdep_read(dev, dev->ops->revents(dev, dev->pfd));
+			if (dev->eof)
+				mux_mdep_del(dev);
+		}
+	}
+#else
 	if (res > 0) {
 		for (dev = mididev_list; dev != NULL; dev = dev->next) {
-			pfd = dev->pfd;
-			if (pfd == NULL)
+			if (dev->pfd == NULL)
 				continue;
-			revents = dev->ops->revents(dev, pfd);
-			if (revents & POLLIN) {
-				res = dev->ops->read(dev, midibuf, MIDI_BUFSIZE);
-				if (dev->eof) {
-					mux_errorcb(dev->unit);
-					continue;
-				}
-				if (dev->isensto > 0) {
-					dev->isensto = MIDIDEV_ISENSTO;
-				}
-				mididev_inputcb(dev, midibuf, res);
-			}
-			if (revents & POLLHUP) {
-				dev->eof = 1;
-				mux_errorcb(dev->unit);
-			}
+			mux_mdep_read(dev, dev->ops->revents(dev, dev->pfd));
 		}
 	}
+#endif
 	if (mux_isopen) {
 		if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
 			log_perror("mux_mdep_wait: clock_gettime");
@@ -276,7 +568,7 @@ mux_mdep_wait(int docons)
 			if (revents & POLLHUP)
 				cons_eof = 1;
 		} else {
-			if (tty_pfds->revents & POLLIN) {
+			if (tty_pfds->revents & (POLLIN | POLLHUP)) {
 				res = read(STDIN_FILENO, midibuf, MIDI_BUFSIZE);
 				if (res < 0) {
 					cons_eof = 1;
@@ -26,6 +26,7 @@
 #include <alsa/asoundlib.h>
 #include "utils.h"
 #include "mididev.h"
+#include "mux.h"
 #include "str.h"
 
 struct alsa {
@@ -35,6 +36,7 @@ struct alsa {
 	char *path;			/* e.g. "128:0", translated in dst */
 	snd_midi_event_t *iparser;	/* midi input event parser */
 	snd_midi_event_t *oparser;	/* midi output event parser */
+	int queue;			/* queue to schedule output on */
 	int nfds;
 };
 
@@ -51,6 +53,7 @@ struct devops alsa_ops = {
 	alsa_open,
 	alsa_read,
 	alsa_write,
+	NULL,			/* the seq handle isn't thread-safe */
 	alsa_nfds,
 	alsa_pollfd,
 	alsa_revents,
@@ -86,6 +89,7 @@ alsa_new(char *path, unsigned mode)
 	dev->port = -1;
 	dev->iparser = NULL;
 	dev->oparser = NULL;
+	dev->queue = -1;
 	return (struct mididev *)&dev->mididev;
 }
 
@@ -105,6 +109,7 @@ alsa_open(struct mididev *addr)
 {
 	struct alsa *dev = (struct alsa *)addr;
 	struct snd_seq_addr dst;
+	snd_seq_t *seq;
 	unsigned int mode;
 	char name[32];
 
@@ -166,6 +171,22 @@ alsa_open(struct mididev *addr)
 			dev->mididev.eof = 1;
 			return;
 		}
+
+		/*
+		 * create a queue to deliver events at given times,
+		 * if this fails events are sent immediately
+		 */
+		seq = dev->seq_handle;
+		dev->queue = snd_seq_alloc_queue(seq);
+		if (dev->queue < 0 ||
+		    snd_seq_start_queue(seq, dev->queue, NULL) < 0 ||
+		    snd_seq_drain_output(seq) < 0) {
+			log_puts("alsa_open: couldn't start queue\n");
+			if (dev->queue >= 0)
+				snd_seq_free_queue(seq, dev->queue);
+			dev->queue = -1;
+		} else
+			dev->mididev.tstamp = 1;
 	}
 
 	/*
@@ -201,6 +222,15 @@ alsa_close(struct mididev *addr)
 {
 	struct alsa *dev = (struct alsa *)addr;
 
+	/*
+	 * wait for scheduled events to be delivered
+	 */
+	if (dev->queue >= 0) {
+		if (!dev->mididev.eof)
+			(void)snd_seq_sync_output_queue(dev->seq_handle);
+		snd_seq_free_queue(dev->seq_handle, dev->queue);
+		dev->queue = -1;
+	}
 	if (dev->iparser) {
 		snd_midi_event_free(dev->iparser);
 		dev->iparser = NULL;
@@ -255,11 +285,27 @@ alsa_write(struct mididev *addr, unsigned char *buf, unsigned count)
 	struct alsa *dev = (struct alsa *)addr;
 	unsigned todo = count;
 	snd_seq_event_t ev;
+	snd_seq_real_time_t rt;
+	unsigned long delta;
+	unsigned queued;
 	long len;
 
 	if (!dev->seq_handle || !dev->oparser)
 		return 0;
 
+	/*
+	 * if the data must be delivered later, schedule it relative
+	 * to the current time, the mux clock was updated when we
+	 * woke up
+	 */
+	delta = 0;
+	if (dev->queue >= 0 && dev->mididev.otime != 0 &&
+	    (long)(dev->mididev.otime - mux_wallclock) > 0) {
+		delta = (dev->mididev.otime - mux_wallclock) / 24;
+		rt.tv_sec = delta / 1000000;
+		rt.tv_nsec = (delta % 1000000) * 1000;
+	}
+	queued = 0;
 	while (todo > 0) {
 		/*
 		 * encode to sequencer commands
@@ -274,14 +320,27 @@ alsa_write(struct mididev *addr, unsigned char *buf, unsigned count)
 		todo -= len;
 		if (ev.type == SND_SEQ_EVENT_NONE)
 			continue;
-		snd_seq_ev_set_direct(&ev);
 		snd_seq_ev_set_dest(&ev, SND_SEQ_ADDRESS_SUBSCRIBERS, 255);
 		snd_seq_ev_set_source(&ev, dev->port);
+		if (delta > 0) {
+			snd_seq_ev_schedule_real(&ev, dev->queue, 1, &rt);
+			if (snd_seq_event_output(dev->seq_handle, &ev) < 0) {
+				dev->mididev.eof = 1;
+				return 0;
+			}
+			queued = 1;
+			continue;
+		}
+		snd_seq_ev_set_direct(&ev);
 		if (snd_seq_event_output_direct(dev->seq_handle, &ev) < 0) {
 			dev->mididev.eof = 1;
 			return 0;
 		}
 	}
+	if (queued && snd_seq_drain_output(dev->seq_handle) < 0) {
+		dev->mididev.eof = 1;
+		return 0;
+	}
 	return count;
 }
 
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * loop device: a device that doesn't need any hardware or sound
+ * server, useful for tests and benchmarks. Input is injected with
+ * loop_inject() into one end of a socketpair(2), the other end is
+ * polled and read by the mux like any real device. Output is
+ * discarded, or, if a file name is given, each write() is appended
+ * to it as a line containing the time (in microseconds since the
+ * device was opened) followed by the bytes, in hex.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <time.h>
+#include "utils.h"
+#include "cons.h"
+#include "mididev.h"
+#include "str.h"
+
+struct loop {
+	struct mididev mididev;		/* device stuff */
+	char *path;			/* output file, or NULL */
+	FILE *file;			/* output file, if any */
+	int fds[2];			/* we read fds[0], inject on fds[1] */
+	struct timespec ts0;		/* time the device was opened */
+};
+
+void	 loop_open(struct mididev *);
+unsigned loop_read(struct mididev *, unsigned char *, unsigned);
+unsigned loop_write(struct mididev *, unsigned char *, unsigned);
+int	 loop_twrite(struct mididev *, unsigned char *, unsigned);
+unsigned loop_nfds(struct mididev *);
+unsigned loop_pollfd(struct mididev *, struct pollfd *, int);
+int	 loop_revents(struct mididev *, struct pollfd *);
+void	 loop_close(struct mididev *);
+void	 loop_del(struct mididev *);
+
+struct devops loop_ops = {
+	loop_open,
+	loop_read,
+	loop_write,
+	loop_twrite,
+	loop_nfds,
+	loop_pollfd,
+	loop_revents,
+	loop_close,
+	loop_del
+};
+
+struct mididev *
+loop_new(char *path, unsigned mode)
+{
+	struct loop *dev;
+
+	dev = xmalloc(sizeof(struct loop), "loop");
+	mididev_init(&dev->mididev, &loop_ops, mode);
+	dev->path = (path != NULL && *path != '\0') ? str_new(path) : NULL;
+	dev->file = NULL;
+	dev->fds[0] = dev->fds[1] = -1;
+	return (struct mididev *)&dev->mididev;
+}
+
+void
+loop_del(struct mididev *addr)
+{
+	struct loop *dev = (struct loop *)addr;
+
+	mididev_done(&dev->mididev);
+	if (dev->path)
+		str_delete(dev->path);
+	xfree(dev);
+}
+
+void
+loop_open(struct mididev *addr)
+{
+	struct loop *dev = (struct loop *)addr;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, dev->fds) < 0) {
+		log_perror("loop_open: socketpair");
+		dev->fds[0] = dev->fds[1] = -1;
+		dev->mididev.eof = 1;
+		return;
+	}
+
+	/*
+	 * don't block the console if too much data is injected
+	 */
+	if (fcntl(dev->fds[1], F_SETFL, O_NONBLOCK) < 0) {
+		log_perror("loop_open: fcntl");
+		dev->mididev.eof = 1;
+		return;
+	}
+	if (dev->path && (dev->mididev.mode & MIDIDEV_MODE_OUT)) {
+		dev->file = fopen(dev->path, "w");
+		if (dev->file == NULL) {
+			log_perror(dev->path);
+			dev->mididev.eof = 1;
+			return;
+		}
+	}
+	if (clock_gettime(CLOCK_MONOTONIC, &dev->ts0) < 0) {
+		log_perror("loop_open: clock_gettime");
+		dev->mididev.eof = 1;
+		return;
+	}
+}
+
+void
+loop_close(struct mididev *addr)
+{
+	struct loop *dev = (struct loop *)addr;
+
+	if (dev->file) {
+		(void)fclose(dev->file);
+		dev->file = NULL;
+	}
+	if (dev->fds[0] >= 0) {
+		(void)close(dev->fds[0]);
+		(void)close(dev->fds[1]);
+		dev->fds[0] = dev->fds[1] = -1;
+	}
+}
+
+unsigned
+loop_read(struct mididev *addr, unsigned char *buf, unsigned count)
+{
+	struct loop *dev = (struct loop *)addr;
+	ssize_t res;
+
+	res = read(dev->fds[0], buf, count);
+	if (res < 0) {
+		log_perror("loop_read");
+		dev->mididev.eof = 1;
+		return 0;
+	}
+	return res;
+}
+
+unsigned
+loop_write(struct mididev *addr, unsigned char *buf, unsigned count)
+{
+	struct loop *dev = (struct loop *)addr;
+
+	if (loop_twrite(addr, buf, count) < 0) {
+		if (ferror(dev->file))
+			log_perror(dev->path);
+		else
+			log_perror("loop_write: clock_gettime");
+		addr->eof = 1;
+		return 0;
+	}
+	return count;
+}
+
+/*
+ * the output file is only closed once the output thread is
+ * terminated, and stdio locks it, so this is thread-safe. On error,
+ * return -1 and set errno; the error indicator of the file is set
+ * if writing failed. Lines are flushed, so errors aren't delayed
+ */
+int
+loop_twrite(struct mididev *addr, unsigned char *buf, unsigned count)
+{
+	struct loop *dev = (struct loop *)addr;
+	struct timespec ts;
+	long long usec;
+	unsigned i;
+
+	if (dev->file == NULL)
+		return count;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		return -1;
+	usec = 1000000LL * (ts.tv_sec - dev->ts0.tv_sec);
+	usec += (ts.tv_nsec - dev->ts0.tv_nsec) / 1000;
+	fprintf(dev->file, "%lld", usec);
+	for (i = 0; i < count; i++)
+		fprintf(dev->file, " %02x", buf[i]);
+	fprintf(dev->file, "\n");
+	if (fflush(dev->file) == EOF || ferror(dev->file))
+		return -1;
+	return count;
+}
+
+unsigned
+loop_nfds(struct mididev *addr)
+{
+	return 1;
+}
+
+unsigned
+loop_pollfd(struct mididev *addr, struct pollfd *pfd, int events)
+{
+	struct loop *dev = (struct loop *)addr;
+
+	pfd->fd = dev->fds[0];
+	pfd->events = events;
+	pfd->revents = 0;
+	return 1;
+}
+
+int
+loop_revents(struct mididev *addr, struct pollfd *pfd)
+{
+	return pfd->revents;
+}
+
+/*
+ * inject the given bytes as if they were received by the device,
+ * they will be processed on the next poll(2). Return 0 if the device
+ * isn't open or if there's not enough space to store the bytes.
+ */
+unsigned
+loop_inject(struct mididev *addr, unsigned char *buf, unsigned count)
+{
+	struct loop *dev = (struct loop *)addr;
+	ssize_t res;
+
+	if (dev->fds[1] < 0) {
+		cons_err("device not open");
+		return 0;
+	}
+	while (count > 0) {
+		res = write(dev->fds[1], buf, count);
+		if (res < 0) {
+			cons_err("device input buffer full");
+			return 0;
+		}
+		count -= res;
+		buf += res;
+	}
+	return 1;
+}
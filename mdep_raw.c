@@ -33,6 +33,7 @@ struct raw {
 void	 raw_open(struct mididev *);
 unsigned raw_read(struct mididev *, unsigned char *, unsigned);
 unsigned raw_write(struct mididev *, unsigned char *, unsigned);
+int	 raw_twrite(struct mididev *, unsigned char *, unsigned);
 unsigned raw_nfds(struct mididev *);
 unsigned raw_pollfd(struct mididev *, struct pollfd *, int);
 int	 raw_revents(struct mididev *, struct pollfd *);
@@ -43,6 +44,7 @@ struct devops raw_ops = {
 	raw_open,
 	raw_read,
 	raw_write,
+	raw_twrite,
 	raw_nfds,
 	raw_pollfd,
 	raw_revents,
@@ -141,6 +143,14 @@ raw_write(struct mididev *addr, unsigned char *buf, unsigned count)
 	return res;
 }
 
+int
+raw_twrite(struct mididev *addr, unsigned char *buf, unsigned count)
+{
+	struct raw *dev = (struct raw *)addr;
+
+	return write(dev->fd, buf, count);
+}
+
 unsigned
 raw_nfds(struct mididev *addr)
 {
@@ -40,6 +40,7 @@ struct devops sndio_ops = {
 	sndio_open,
 	sndio_read,
 	sndio_write,
+	NULL,			/* mio handles aren't thread-safe */
 	sndio_nfds,
 	sndio_pollfd,
 	sndio_revents,
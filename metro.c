@@ -60,17 +60,26 @@ metro_tocb(void *addr)
 {
 	struct metro *o = (struct metro *)addr;
 	struct ev ev;
+	unsigned long otime;
 
 	if (o->ev == NULL) {
 		log_puts("metro_tocb: no click sounding\n");
 		panic();
 	}
+
+	/*
+	 * if the click was scheduled ahead, the note-off must be too
+	 */
+	otime = mux_otime;
+	if (otime == 0 && mux_ahead)
+		mux_otime = mux_wallclock + mux_ahead;
 	ev.cmd = EV_NOFF;
 	ev.dev = o->ev->dev;
 	ev.ch  = o->ev->ch;
 	ev.note_num = o->ev->note_num;
 	ev.note_vel = EV_NOFF_DEFAULTVEL;
 	mux_putev(&ev);
+	mux_otime = otime;
 	o->ev = NULL;
 }
 
@@ -43,6 +43,7 @@
  *
  */
 
+#include <string.h>
 #include "utils.h"
 #include "defs.h"
 #include "mididev.h"
@@ -54,6 +55,7 @@
 #include "mux.h"
 #include "timo.h"
 #include "conv.h"
+#include "othread.h"
 
 #define MIDI_SYSEXSTART	0xf0
 #define MIDI_QFRAME	0xf1
@@ -76,6 +78,10 @@ unsigned mididev_evlen[] = { 2, 2, 2, 2, 1, 1, 2, 0 };
 struct mididev *mididev_list, *mididev_clksrc, *mididev_mtcsrc;
 struct mididev *mididev_byunit[DEFAULT_MAXNDEVS];
 
+void mtc_timocb(void *);
+void mididev_isenstocb(void *);
+void mididev_osenstocb(void *);
+
 /*
  * initialize the mtc "parser" to a state, when a full message or 2 complete
  * frames are needed to lock to the master
@@ -87,9 +93,19 @@ mtc_init(struct mtc *mtc)
 	mtc->qfr = 0;
 	mtc->pos = 0xdeadbeef;
 	mtc->state = MTC_STOP;
-	mtc->timo = 0;
+	timo_set(&mtc->timo, mtc_timocb, mtc);
 };
 
+/*
+ * abort the timeout of the mtc "parser"
+ */
+void
+mtc_done(struct mtc *mtc)
+{
+	if (mtc->timo.set)
+		timo_del(&mtc->timo);
+}
+
 /*
  * convert MTC-style frames per second into MTC_SEC units
  * return 0 if not supported
@@ -122,8 +138,10 @@ mtc_setfps(struct mtc *mtc, unsigned id)
  * called when timeout expires, ie MTC stopped
  */
 void
-mtc_timo(struct mtc *mtc)
+mtc_timocb(void *addr)
 {
+	struct mtc *mtc = (struct mtc *)addr;
+
 	if (mididev_debug)
 		log_puts("mtc_timo: stopped\n");
 	mtc->state = MTC_STOP;
@@ -158,7 +176,9 @@ mtc_tick(struct mtc *mtc, unsigned data)
 	mtc->nibble[mtc->qfr++] = data & 0xf;
 	if (mtc->qfr < 8)
 		return;
-	mtc->timo = 24000000 / 4;
+	if (mtc->timo.set)
+		timo_del(&mtc->timo);
+	timo_add(&mtc->timo, 24000000 / 4);
 	pos = mtc->tps * 4 * (mtc->nibble[0] +  (mtc->nibble[1]      << 4)) +
 	    MTC_SEC *        (mtc->nibble[2] +  (mtc->nibble[3]      << 4)) +
 	    MTC_SEC * 60 *   (mtc->nibble[4] +  (mtc->nibble[5]      << 4)) +
@@ -231,6 +251,7 @@ mididev_init(struct mididev *o, struct devops *ops, unsigned mode)
 	 * (midi_tic, midi_start, midi_stop etc...)
 	 */
 	o->ops = ops;
+	o->pfd = NULL;
 	o->sendclk = 0;
 	o->sendmmc = 1;
 	o->ticrate = DEFAULT_TPU;
@@ -250,6 +271,12 @@ mididev_init(struct mididev *o, struct devops *ops, unsigned mode)
 	o->isysex = NULL;
 	o->runst = 1;
 	o->sync = 0;
+	o->othread = 0;
+	o->othr = NULL;
+	o->tstamp = 0;
+	o->otime = 0;
+	timo_set(&o->isensto, mididev_isenstocb, o);
+	timo_set(&o->osensto, mididev_osenstocb, o);
 }
 
 /*
@@ -273,8 +300,23 @@ mididev_open(struct mididev *o)
 	o->oused = 0;
 	o->istatus = o->ostatus = 0;
 	o->isysex = NULL;
+	o->otime = 0;
+	o->tstamp = 0;
 	mtc_init(&o->imtc);
 	o->ops->open(o);
+	if (o->othread && o->ops->twrite &&
+	    !o->eof && (o->mode & MIDIDEV_MODE_OUT)) {
+		o->othr = othread_new(o);
+
+		/*
+		 * the ring doesn't store delivery times, so send
+		 * everything immediately
+		 */
+		if (o->othr)
+			o->tstamp = 0;
+	}
+	mux_mdep_add(o);
+	timo_add(&o->osensto, MIDIDEV_OSENSTO);
 }
 
 /*
@@ -284,8 +326,43 @@ void
 mididev_close(struct mididev *o)
 {
 	mididev_flush(o);
+	mux_mdep_del(o);
+	if (o->othr) {
+		othread_del(o->othr);
+		o->othr = NULL;
+	}
 	o->ops->close(o);
 	o->eof = 1;
+	mtc_done(&o->imtc);
+	if (o->isensto.set)
+		timo_del(&o->isensto);
+	if (o->osensto.set)
+		timo_del(&o->osensto);
+}
+
+/*
+ * called when no input was received during MIDIDEV_ISENSTO, while
+ * active sensing is enabled
+ */
+void
+mididev_isenstocb(void *addr)
+{
+	struct mididev *o = (struct mididev *)addr;
+
+	cons_erru(o->unit, "sensing timeout, disabled");
+}
+
+/*
+ * called when nothing was sent during MIDIDEV_OSENSTO, send an
+ * active sensing message; flushing it will schedule the next one
+ */
+void
+mididev_osenstocb(void *addr)
+{
+	struct mididev *o = (struct mididev *)addr;
+
+	mididev_putack(o);
+	mididev_flush(o);
 }
 
 /*
@@ -313,6 +390,10 @@ mididev_flush(struct mididev *o)
 		}
 		todo = o->oused;
 		buf = o->obuf;
+		if (o->othr) {
+			othread_write(o->othr, buf, todo);
+			todo = 0;
+		}
 		while (todo > 0) {
 			count = o->ops->write(o, buf, todo);
 			if (o->eof)
@@ -320,15 +401,18 @@ mididev_flush(struct mididev *o)
 			todo -= count;
 			buf += count;
 		}
-		if (o->oused)
-			o->osensto = MIDIDEV_OSENSTO;
+		if (o->oused) {
+			if (o->osensto.set)
+				timo_del(&o->osensto);
+			timo_add(&o->osensto, MIDIDEV_OSENSTO);
+		}
 	}
 	o->oused = 0;
 }
 
 /*
  * mididev_inputcb is called when midi data becomes available
- * it calls mux_evcb
+ * it calls mux_evcb for each event, then flushes the output
  */
 void
 mididev_inputcb(struct mididev *o, unsigned char *buf, unsigned count)
@@ -340,6 +424,10 @@ mididev_inputcb(struct mididev *o, unsigned char *buf, unsigned count)
 		log_puts("received data from output only device\n");
 		return;
 	}
+	if (o->isensto.set) {
+		timo_del(&o->isensto);
+		timo_add(&o->isensto, MIDIDEV_ISENSTO);
+	}
 	if (mididev_debug) {
 		log_puts("mididev_inputcb: ");
 		log_putu(timo_abstime / 24);
@@ -464,18 +552,39 @@ mididev_inputcb(struct mididev *o, unsigned char *buf, unsigned count)
 			o->istatus = 0;
 		}
 	}
+
+	/*
+	 * send the output resulting from the whole buffer at once
+	 */
+	mux_flush();
+}
+
+/*
+ * set the time at which the next bytes must be delivered. Bytes
+ * already in the buffer have a different delivery time, so flush them
+ * first
+ */
+void
+mididev_settime(struct mididev *o)
+{
+	if (o->oused > 0)
+		mididev_flush(o);
+	o->otime = mux_otime;
 }
 
 /*
  * write a single midi byte to the output buffer, if
  * it is full, flush it. Shouldn't we inline it?
  */
+
 void
 mididev_out(struct mididev *o, unsigned data)
 {
 	if (!(o->mode & MIDIDEV_MODE_OUT)) {
 		return;
 	}
+	if (o->otime != mux_otime && o->tstamp)
+		mididev_settime(o);
 	if (o->oused == MIDIDEV_BUFLEN) {
 		mididev_flush(o);
 	}
@@ -594,6 +703,8 @@ mididev_sendraw(struct mididev *o, unsigned char *buf, unsigned len)
 	if (!(o->mode & MIDIDEV_MODE_OUT)) {
 		return;
 	}
+	if (o->otime != mux_otime && o->tstamp)
+		mididev_settime(o);
 	while (len > 0) {
 		if (o->oused == MIDIDEV_BUFLEN) {
 			mididev_flush(o);
@@ -662,13 +773,18 @@ mididev_attach(unsigned unit, char *path, unsigned mode)
 		cons_err("device already exists");
 		return 0;
 	}
+	if (path != NULL &&
+	    strncmp(path, MIDIDEV_LOOP, sizeof(MIDIDEV_LOOP) - 1) == 0)
+		dev = loop_new(path + sizeof(MIDIDEV_LOOP) - 1, mode);
+	else {
 #if defined(USE_SNDIO)
-	dev = sndio_new(path, mode);
+		dev = sndio_new(path, mode);
 #elif defined(USE_ALSA)
-	dev = alsa_new(path, mode);
+		dev = alsa_new(path, mode);
 #else
-	dev = raw_new(path, mode);
+		dev = raw_new(path, mode);
 #endif
+	}
 	if (dev == NULL)
 		return 0;
 	dev->next = mididev_list;
@@ -17,6 +17,8 @@
 #ifndef MIDISH_MIDIDEV_H
 #define MIDISH_MIDIDEV_H
 
+#include "timo.h"
+
 /*
  * timeouts for active sensing
  * (as usual units are 24th of microsecond)
@@ -35,8 +37,14 @@
  */
 #define MIDIDEV_BUFLEN	0x400
 
+/*
+ * prefix of paths of loop devices, eg. "loop:" or "loop:out.txt"
+ */
+#define MIDIDEV_LOOP	"loop:"
+
 struct pollfd;
 struct mididev;
+struct othread;
 struct ev;
 
 struct devops {
@@ -54,6 +62,13 @@ struct devops {
 	 * of bytes actually written, set the ``eof'' flag on error
 	 */
 	unsigned (*write)(struct mididev *, unsigned char *, unsigned);
+	/*
+	 * same as write, but called by the output thread: it must not
+	 * log or modify the device structure. Return the number of
+	 * bytes written, or -1 and set errno on error. NULL if the
+	 * device can't be written from a separate thread
+	 */
+	int (*twrite)(struct mididev *, unsigned char *, unsigned);
 	/*
 	 * return the number of pollfd structures the device requires
 	 */
@@ -91,7 +106,7 @@ struct mtc {
 #define MTC_START	1		/* got a full frame but no tick yet */
 #define MTC_RUN		2		/* got at least 1 tick */
 	unsigned state;			/* one of above */
-	unsigned timo;
+	struct timo timo;		/* to detect when MTC stops */
 };
 
 struct mididev {
@@ -110,13 +125,15 @@ struct mididev {
 	unsigned ticrate, ticdelta;	/* tick rate (default 96) */
 	unsigned sendclk;		/* send MIDI clock */
 	unsigned sendmmc;		/* send MMC start/stop/relocate */
-	unsigned isensto, osensto;	/* active sensing timeouts */
+	struct timo isensto, osensto;	/* active sensing timeouts */
 	unsigned mode;			/* read, write */
 	unsigned ixctlset, oxctlset;	/* bitmap of 14bit controllers */
 	unsigned ievset, oevset;	/* bitmap of CONV_{XPC,NRPN,RPN} */
 	unsigned eof;			/* i/o error pending */
 	unsigned runst;			/* use running status for output */
 	unsigned sync;			/* flush buffer after each message */
+	unsigned othread;		/* write from a separate thread */
+	unsigned tstamp;		/* write() schedules at 'otime' */
 
 	/*
 	 * midi events parser state
@@ -129,11 +146,14 @@ struct mididev {
 	unsigned 	  oused;		/* bytes in obuf */
 	unsigned	  ostatus;		/* output running status */
 	unsigned char	  obuf[MIDIDEV_BUFLEN];	/* output buffer */
+	unsigned long	  otime;		/* when to deliver obuf, 0 = now */
+	struct othread	 *othr;			/* output thread, if any */
 };
 
 void mididev_init(struct mididev *, struct devops *, unsigned);
 void mididev_done(struct mididev *);
 void mididev_flush(struct mididev *);
+void mididev_settime(struct mididev *);
 void mididev_putstart(struct mididev *);
 void mididev_putstop(struct mididev *);
 void mididev_puttic(struct mididev *);
@@ -144,8 +164,6 @@ void mididev_open(struct mididev *);
 void mididev_close(struct mididev *);
 void mididev_inputcb(struct mididev *, unsigned char *, unsigned);
 
-void mtc_timo(struct mtc *); /* XXX, use timeouts */
-
 extern unsigned mididev_debug;
 
 extern struct mididev *mididev_list;
@@ -154,6 +172,9 @@ extern struct mididev *mididev_mtcsrc;
 extern struct mididev *mididev_byunit[];
 
 struct mididev *raw_new(char *, unsigned);
+struct mididev *loop_new(char *, unsigned);
+extern struct devops loop_ops;
+unsigned loop_inject(struct mididev *, unsigned char *, unsigned);
 struct mididev *alsa_new(char *, unsigned);
 struct mididev *sndio_new(char *, unsigned);
 
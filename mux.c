@@ -65,6 +65,7 @@
 #include "mididev.h"
 #include "sysex.h"
 #include "timo.h"
+#include "rtstat.h"
 #include "state.h"
 #include "conv.h"
 
@@ -79,6 +80,11 @@
  */
 #define MUX_START_DELAY	  (24000000UL / 3)
 
+/*
+ * period at which timer statistics are reported, 1 second
+ */
+#define MUX_STAT_PERIOD	  24000000UL
+
 unsigned mux_isopen = 0;
 unsigned mux_debug = 0;
 unsigned mux_ticrate;
@@ -86,8 +92,17 @@ unsigned long mux_ticlength, mux_curpos, mux_nextpos;
 unsigned mux_curtic;
 unsigned mux_phase, mux_reqphase;
 unsigned mux_manualstart = 1;
+unsigned mux_tickless = 0;
+unsigned long mux_lookahead = 0;	/* look-ahead window, set by the user */
+unsigned long mux_ahead = 0;		/* look-ahead window in use */
+unsigned long mux_otime = 0;		/* when to deliver output, 0 = now */
+unsigned mux_canahead;			/* all outputs can be scheduled */
+unsigned mux_render = 0;		/* capture output, don't use devices */
 void *mux_addr;
 unsigned long mux_wallclock;
+unsigned long mux_statclock;
+unsigned mux_ntimercb;
+unsigned mux_timerrate, mux_timorate;	/* calls in the last second */
 
 
 struct statelist mux_istate, mux_ostate;
@@ -133,17 +148,31 @@ mux_open(void)
 	mux_isopen = 1;
 	for (i = mididev_list; i != NULL; i = i->next) {
 		i->ticdelta = i->ticrate;
-		i->isensto = 0;
-		i->osensto = MIDIDEV_OSENSTO;
-		mididev_open(i);
+		if (!mux_render)
+			mididev_open(i);
+	}
+	if (!mux_render)
+		mux_mdep_open();
+
+	/*
+	 * processing of the clock may be delayed only if the output
+	 * of all devices is scheduled
+	 */
+	mux_canahead = 1;
+	for (i = mididev_list; i != NULL; i = i->next) {
+		if ((i->mode & MIDIDEV_MODE_OUT) && !i->tstamp)
+			mux_canahead = 0;
 	}
-	mux_mdep_open();
+	mux_otime = 0;
 
 	mux_curpos = 0;
 	mux_nextpos = 0;
 	mux_reqphase = MUX_STOP;
 	mux_phase = MUX_STOP;
 	mux_wallclock = 0;
+	mux_statclock = 0;
+	mux_ntimercb = 0;
+	mux_timerrate = mux_timorate = 0;
 	log_sync = 1;
 }
 
@@ -164,9 +193,11 @@ mux_close(void)
 			cons_err("lost incomplete sysex");
 			sysex_del(i->isysex);
 		}
-		mididev_close(i);
+		if (!mux_render)
+			mididev_close(i);
 	}
-	mux_mdep_close();
+	if (!mux_render)
+		mux_mdep_close();
 	mux_isopen = 0;
 	statelist_done(&mux_ostate);
 	statelist_done(&mux_istate);
@@ -306,6 +337,10 @@ mux_putev(struct ev *ev)
 		log_puts(": bogus unit number\n");
 		panic();
 	}
+	if (mux_render) {
+		song_rendercb(usong, ev);
+		return;
+	}
 	dev = mididev_byunit[unit];
 	if (dev != NULL) {
 		nev = conv_unpackev(&mux_ostate,
@@ -328,7 +363,7 @@ mux_sendraw(unsigned unit, unsigned char *buf, unsigned len)
 	if (unit >= DEFAULT_MAXNDEVS) {
 		return;
 	}
-	if (len == 0) {
+	if (len == 0 || mux_render) {
 		return;
 	}
 	dev = mididev_byunit[unit];
@@ -403,9 +438,25 @@ mux_mtctick(unsigned delta)
 		 * the start signal).
 		 */
 		if (!mux_manualstart || mux_phase != MUX_START) {
+			/*
+			 * the tick was due 'mux_curpos' ago
+			 */
+			if (!mux_render)
+				rtstat_add(&rtstat_tick, mux_curpos / 24);
+
+			/*
+			 * in look-ahead mode, the output of this tick
+			 * is delivered 'mux_ahead' after the time the
+			 * tick was due
+			 */
+			if (mux_ahead) {
+				mux_otime = mux_wallclock - mux_curpos +
+				    mux_ahead;
+			}
 			mux_sendtic();
 			mux_ticcb();
 			mux_flush();
+			mux_otime = 0;
 		}
 	}
 }
@@ -438,50 +489,38 @@ mux_mtcstop(void)
 void
 mux_timercb(unsigned long delta)
 {
-	struct mididev *dev;
-
 	/*
 	 * update wall clock
 	 */
 	mux_wallclock += delta;
-
+	if (!mux_render)
+		rtstat_add(&rtstat_timer, delta / 24);
 
 	/*
-	 * run expired timeouts
+	 * count calls and expired timeouts, and save them every
+	 * second for the rtstat command
 	 */
-	timo_update(delta);
+	mux_ntimercb++;
+	mux_statclock += delta;
+	if (mux_statclock >= MUX_STAT_PERIOD) {
+		if (mux_debug) {
+			log_puts("mux_timercb: ");
+			log_putu(mux_ntimercb);
+			log_puts(" calls, ");
+			log_putu(timo_ncalls);
+			log_puts(" timeouts in the last second\n");
+		}
+		mux_statclock -= MUX_STAT_PERIOD;
+		mux_timerrate = mux_ntimercb;
+		mux_timorate = timo_ncalls;
+		mux_ntimercb = 0;
+		timo_ncalls = 0;
+	}
 
 	/*
-	 * handle timeouts not using the timo.c interface
-	 * XXX: convert this to timo_xxx() routines
+	 * run expired timeouts
 	 */
-	for (dev = mididev_list; dev != NULL; dev = dev->next) {
-		if (dev->isensto) {
-			if (dev->isensto <= delta) {
-				dev->isensto = 0;
-				cons_erru(dev->unit, "sensing timeout, disabled");
-			} else {
-				dev->isensto -= delta;
-			}
-		}
-		if (dev->osensto) {
-			if (dev->osensto <= delta) {
-				mididev_putack(dev);
-				mididev_flush(dev);
-				dev->osensto = MIDIDEV_OSENSTO;
-			} else {
-				dev->osensto -= delta;
-			}
-		}
-		if (dev->imtc.timo) {
-			if (dev->imtc.timo <= delta) {
-				dev->imtc.timo = 0;
-				mtc_timo(&dev->imtc);
-			} else {
-				dev->imtc.timo -= delta;
-			}
-		}
-	}
+	timo_update(delta);
 
 	/*
 	 * if there's no ext MTC source, then generate one internally
@@ -511,6 +550,41 @@ mux_timercb(unsigned long delta)
 	}
 }
 
+/*
+ * store in 'rdelta' the time (in 24th of microsecond) until the
+ * next call to mux_timercb() has something to do, and return 1. If
+ * there's nothing to do until the next input event, return 0. Used
+ * by the tickless timer to sleep until the next deadline.
+ */
+unsigned
+mux_nexttimo(unsigned long *rdelta)
+{
+	unsigned long delta, ticdelta;
+	unsigned found, timo;
+
+	found = timo_next(&timo);
+	delta = timo;
+	if (!mididev_mtcsrc && !mididev_clksrc &&
+	    mux_phase >= MUX_START && mux_phase <= MUX_NEXT) {
+		ticdelta = mux_curpos < mux_nextpos ?
+		    mux_nextpos - mux_curpos : 0;
+
+		/*
+		 * if the output is scheduled ahead, ticks may be
+		 * processed late without any effect on timing
+		 */
+		if (mux_ahead && mux_canahead)
+			ticdelta += mux_ahead / 2;
+		if (!found || delta > ticdelta) {
+			delta = ticdelta;
+			found = 1;
+		}
+	}
+	if (found)
+		*rdelta = delta;
+	return found;
+}
+
 /*
  * called when a MIDI TICK is received
  */
@@ -588,9 +662,9 @@ mux_ackcb(unsigned unit)
 {
 	struct mididev *dev = mididev_byunit[unit];
 
-	if (dev->isensto == 0) {
+	if (!dev->isensto.set) {
 		cons_erru(dev->unit, "sensing enabled");
-		dev->isensto = MIDIDEV_ISENSTO;
+		timo_add(&dev->isensto, MIDIDEV_ISENSTO);
 	}
 }
 
@@ -783,6 +857,13 @@ mux_stopreq(void)
 	struct mididev *dev;
 	static unsigned char mmc_stop[] = { 0xf0, 0x7f, 0x7f, 0x06, 0x01, 0xf7 };
 
+	/*
+	 * in look-ahead mode, deliver the stop after the events
+	 * already scheduled, so notes get cancelled
+	 */
+	if (mux_ahead)
+		mux_otime = mux_wallclock + mux_ahead;
+
 	mux_reqphase = MUX_STOP;
 	if (mux_phase > MUX_START && mux_phase < MUX_STOP)
 		mux_sendstop();
@@ -793,6 +874,7 @@ mux_stopreq(void)
 		if (dev->sendmmc)
 			mididev_sendraw(dev, mmc_stop, sizeof(mmc_stop));
 	}
+	mux_otime = 0;
 }
 
 /*
@@ -27,6 +27,7 @@
 
 struct ev;
 struct sysex;
+struct mididev;
 
 /*
  * modules are chained as follows: mux -> norm -> filt -> song -> output
@@ -43,12 +44,17 @@ struct song;
 extern struct song *usong;
 extern unsigned mux_isopen;
 extern unsigned mux_manualstart;
+extern unsigned mux_tickless;
+extern unsigned long mux_lookahead, mux_ahead, mux_otime;
+extern unsigned mux_render;
 extern unsigned long mux_wallclock;
+extern unsigned mux_timerrate, mux_timorate;
 
 void song_startcb(struct song *);
 void song_stopcb(struct song *);
 void song_movecb(struct song *);
 void song_evcb(struct song *, struct ev *);
+void song_rendercb(struct song *, struct ev *);
 void song_sysexcb(struct song *, struct sysex *);
 unsigned song_gotocb(struct song *, unsigned);
 
@@ -78,11 +84,14 @@ void mux_startreq(int);
 void mux_stopreq(void);
 void mux_gotoreq(unsigned);
 int mux_mdep_wait(int); /* XXX: hide this prototype */
+void mux_mdep_add(struct mididev *);
+void mux_mdep_del(struct mididev *);
 
 /*
  * call-backs called by midi device drivers
  */
 void mux_timercb(unsigned long);
+unsigned mux_nexttimo(unsigned long *);
 void mux_startcb(void);
 void mux_stopcb(void);
 void mux_ticcb(void);
@@ -29,11 +29,11 @@
 #include "mux.h"
 #include "filt.h"
 #include "mixout.h"
-
-struct song;
+#include "song.h"
 
 #define TAG_PASS 1
 #define TAG_PENDING 2
+#define TAG_IDLE 4
 
 /*
  * timeout for throtteling: 1 tick at 60 bpm
@@ -41,6 +41,7 @@ struct song;
 #define NORM_TIMO TEMPO_TO_USEC24(120,24)
 
 unsigned norm_debug = 0;
+unsigned norm_lowlat = 0;		/* flush after each event */
 struct statelist norm_slist;		/* state of the normilizer */
 struct timo norm_timo;			/* for throtteling */
 
@@ -49,7 +50,9 @@ struct timo norm_timo;			/* for throtteling */
 void norm_timocb(void *);
 
 /*
- * inject an event
+ * inject an event. Output is not flushed (unless in low-latency
+ * mode), so bursts of input events are sent with a single write;
+ * callers must call mux_flush() once they're done
  */
 void
 norm_putev(struct ev *ev)
@@ -57,7 +60,98 @@ norm_putev(struct ev *ev)
 	if (!EV_ISVOICE(ev) && !EV_ISSX(ev))
 		return;
 	song_evcb(usong, ev);
-	mux_flush();
+	if (norm_lowlat)
+		mux_flush();
+}
+
+/*
+ * set the thinning policy of the given set of events, replacing any
+ * policy of the same set. If all parameters are zero, the policy is
+ * removed
+ */
+void
+norm_thinset(struct normthin **list, struct evspec *es,
+    unsigned msec, unsigned delta, unsigned smooth)
+{
+	struct normthin *t, **pt;
+
+	for (pt = list; (t = *pt) != NULL; pt = &t->next) {
+		if (evspec_eq(&t->es, es))
+			break;
+	}
+	if (msec == 0 && delta == 0 && smooth == 0) {
+		if (t != NULL) {
+			*pt = t->next;
+			xfree(t);
+		}
+		return;
+	}
+	if (t == NULL) {
+		t = xmalloc(sizeof(struct normthin), "normthin");
+		t->next = NULL;
+		t->es = *es;
+		*pt = t;
+	}
+	t->msec = msec;
+	t->delta = delta;
+	t->smooth = smooth;
+}
+
+/*
+ * remove all thinning policies of the given list
+ */
+void
+norm_thinclear(struct normthin **list)
+{
+	struct normthin *t;
+
+	while ((t = *list) != NULL) {
+		*list = t->next;
+		xfree(t);
+	}
+}
+
+/*
+ * return the thinning policy for the given event, or NULL if there's
+ * none. Policies set later take precedence. Only controllers, bender
+ * and channel aftertouch are thinned, other events are never skipped
+ */
+struct normthin *
+norm_thinlookup(struct ev *ev)
+{
+	struct normthin *t, *res = NULL;
+
+	if (ev->cmd != EV_XCTL && ev->cmd != EV_BEND && ev->cmd != EV_CAT)
+		return NULL;
+	for (t = usong->thinlist; t != NULL; t = t->next) {
+		if (evspec_matchev(&t->es, ev))
+			res = t;
+	}
+	return res;
+}
+
+/*
+ * output the event of the given state, smoothed according to the given
+ * policy (if any), and remember the value sent and the time. If the
+ * value sent is not the actual one, keep the state pending, so the
+ * actual value is sent once the input is idle
+ */
+void
+norm_putstate(struct state *st, struct normthin *t)
+{
+	struct ev ev;
+	unsigned *pval;
+
+	ev = st->ev;
+	pval = (evinfo[ev.cmd].nparams > 1) ? &ev.v1 : &ev.v0;
+	if (t != NULL && t->smooth > 0)
+		*pval = (st->val * t->smooth + *pval * (100 - t->smooth)) / 100;
+	st->val = *pval;
+	st->tic = timo_abstime;
+	st->tag &= ~(TAG_PENDING | TAG_IDLE);
+	if (st->ev.v0 != ev.v0 || st->ev.v1 != ev.v1)
+		st->tag |= TAG_PENDING;
+	norm_putev(&ev);
 }
 
 /*
@@ -132,6 +226,7 @@ norm_shut(void)
 		}
 		s->tag &= ~TAG_PASS;
 	}
+	mux_flush();
 }
 
 /*
@@ -174,6 +269,8 @@ void
 norm_evcb(struct ev *ev)
 {
 	struct state *st;
+	struct normthin *t;
+	unsigned val;
 
 	if (norm_debug) {
 		log_puts("norm_run: ");
@@ -212,20 +309,45 @@ norm_evcb(struct ev *ev)
 	 */
 	if (!(st->tag & TAG_PASS))
 		return;
+	st->tag &= ~TAG_IDLE;
+
+	/*
+	 * the following only applies to events that don't change
+	 * the phase of the frame
+	 */
+	if (st->phase != EV_PHASE_NEXT &&
+	    st->phase != (EV_PHASE_FIRST | EV_PHASE_LAST)) {
+		norm_putstate(st, NULL);
+		st->nevents++;
+		return;
+	}
+
+	/*
+	 * thinning: skip this event if it's too close to the last
+	 * value passed, either in time or in value
+	 */
+	t = (st->flags & STATE_NEW) ? NULL : norm_thinlookup(&st->ev);
+	if (t != NULL) {
+		val = (evinfo[st->ev.cmd].nparams > 1) ?
+		    st->ev.v1 : st->ev.v0;
+		if (timo_abstime - st->tic < t->msec * 24000 ||
+		    (val > st->val ? val - st->val : st->val - val) <
+		    t->delta) {
+			st->tag |= TAG_PENDING;
+			return;
+		}
+	}
 
 	/*
 	 * throttling: if we played more than MAXEV
-	 * events skip this event only if it doesnt change the
-	 * phase of the frame
+	 * events skip this event
 	 */
-	if (st->nevents > NORM_MAXEV &&
-	    (st->phase == EV_PHASE_NEXT ||
-	     st->phase == (EV_PHASE_FIRST | EV_PHASE_LAST))) {
+	if (st->nevents > NORM_MAXEV) {
 		st->tag |= TAG_PENDING;
 		return;
 	}
 
-	norm_putev(&st->ev);
+	norm_putstate(st, t);
 	st->nevents++;
 }
 
@@ -241,11 +363,20 @@ norm_timocb(void *addr)
 	statelist_outdate(&norm_slist);
 	for (i = norm_slist.first; i != NULL; i = i->next) {
 		i->nevents = 0;
-		if (i->tag & TAG_PENDING) {
-			i->tag &= ~TAG_PENDING;
-			norm_putev(&i->ev);
-			i->nevents++;
+		if (!(i->tag & TAG_PENDING))
+			continue;
+
+		/*
+		 * if the events are thinned, pass the last value only
+		 * once no events were received during a whole period
+		 */
+		if (!(i->tag & TAG_IDLE) && norm_thinlookup(&i->ev) != NULL) {
+			i->tag |= TAG_IDLE;
+			continue;
 		}
+		norm_putstate(i, NULL);
+		i->nevents++;
 	}
+	mux_flush();
 	timo_add(&norm_timo, NORM_TIMO);
 }
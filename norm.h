@@ -17,19 +17,42 @@
 #ifndef MIDISH_NORM_H
 #define MIDISH_NORM_H
 
+#include "ev.h"
+
 #define NORM_MAXEV	1			/* max events per time slice */
 
 struct filt;
-struct ev;
+
+/*
+ * thinning policy of a set of controllers (or bender, aftertouch...):
+ * a new value is passed only if at least 'msec' milliseconds elapsed
+ * and if it changed by at least 'delta' since the last value passed.
+ * Other values are dropped, except the last one, passed once no
+ * more events are received
+ */
+struct normthin {
+	struct normthin *next;		/* next policy in the list */
+	struct evspec es;		/* events to thin */
+	unsigned msec;			/* min interval */
+	unsigned delta;			/* min change of the value */
+	unsigned smooth;		/* percent of the previous value */
+};
+
+#define NORM_THIN_MAXMSEC	10000	/* max interval */
+#define NORM_THIN_MAXSMOOTH	99	/* max smoothing */
 
 void norm_start(void);
 void norm_shut(void);
 void norm_stop(void);
 void norm_putev(struct ev *);
+void norm_thinset(struct normthin **, struct evspec *,
+    unsigned, unsigned, unsigned);
+void norm_thinclear(struct normthin **);
 
 void norm_evcb(struct ev *);
 void norm_timercb(void);
 
 extern unsigned norm_debug;
+extern unsigned norm_lowlat;
 
 #endif /* MIDISH_NORM_H */
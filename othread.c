@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * output thread: a thread that writes the output of a single device,
+ * so that a slow write(2) (or a device blocking) doesn't delay the
+ * main thread, which runs the clock, parses the console input etc...
+ *
+ * mididev_flush() stores the bytes to send in a single-producer,
+ * single-consumer ring buffer, the output thread then sends them
+ * using the device write() method. The ring doesn't use locks: the
+ * producer only updates 'head' and the consumer only updates
+ * 'tail', both are free running counters.
+ *
+ * When the ring is empty, the thread sleeps on a condition
+ * variable. The mutex is only used to avoid missing a wakeup, ie it's
+ * never taken if the thread is running.
+ *
+ * The thread never logs nor touches the device structure: it uses
+ * the twrite() method of the device and, on error, only stores errno,
+ * which the main thread picks with othread_geterr(). Then, the
+ * thread discards anything it's given. If the ring is full, the
+ * producer never waits: it fails with ENOBUFS as if the write
+ * failed, so no data is dropped without the device being closed.
+ *
+ * If possible, the thread runs with SCHED_FIFO scheduling policy.
+ */
+
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include "utils.h"
+#include "mididev.h"
+#include "othread.h"
+
+#define OTHREAD_MASK	(OTHREAD_BUFLEN - 1)
+
+struct othread {
+	struct mididev *dev;		/* device we write to */
+	pthread_t thread;
+	pthread_mutex_t mtx;		/* protects 'sleeping' */
+	pthread_cond_t cond;		/* to wakeup the thread */
+	unsigned sleeping;		/* thread is waiting on 'cond' */
+	unsigned quit;			/* thread must exit when drained */
+	int err;			/* errno of the failed write, or 0 */
+	unsigned head;			/* bytes stored by the producer */
+	unsigned tail;			/* bytes sent by the consumer */
+	unsigned char buf[OTHREAD_BUFLEN];
+};
+
+unsigned othread_debug = 0;
+
+/*
+ * wait until there's something in the ring or until we're asked to
+ * quit. The flags are checked with the mutex held, so that wakeups
+ * can't be missed
+ */
+void
+othread_sleep(struct othread *o)
+{
+	pthread_mutex_lock(&o->mtx);
+	__atomic_store_n(&o->sleeping, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&o->head, __ATOMIC_SEQ_CST) == o->tail &&
+	    !__atomic_load_n(&o->quit, __ATOMIC_SEQ_CST))
+		pthread_cond_wait(&o->cond, &o->mtx);
+	__atomic_store_n(&o->sleeping, 0, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&o->mtx);
+}
+
+/*
+ * wakeup the thread if it's sleeping
+ */
+void
+othread_wakeup(struct othread *o)
+{
+	if (!__atomic_load_n(&o->sleeping, __ATOMIC_SEQ_CST))
+		return;
+	pthread_mutex_lock(&o->mtx);
+	pthread_cond_signal(&o->cond);
+	pthread_mutex_unlock(&o->mtx);
+}
+
+/*
+ * output thread main loop
+ */
+void *
+othread_run(void *arg)
+{
+	struct othread *o = arg;
+	unsigned head, count, start;
+	int n;
+
+	for (;;) {
+		head = __atomic_load_n(&o->head, __ATOMIC_ACQUIRE);
+		if (head == o->tail) {
+			if (__atomic_load_n(&o->quit, __ATOMIC_SEQ_CST))
+				break;
+			othread_sleep(o);
+			continue;
+		}
+		start = o->tail & OTHREAD_MASK;
+		count = head - o->tail;
+		if (count > OTHREAD_BUFLEN - start)
+			count = OTHREAD_BUFLEN - start;
+		if (o->err == 0) {
+			n = o->dev->ops->twrite(o->dev, o->buf + start, count);
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				__atomic_store_n(&o->err, errno,
+				    __ATOMIC_SEQ_CST);
+			} else
+				count = n;
+		}
+		if (o->err != 0)
+			count = head - o->tail;
+		__atomic_store_n(&o->tail, o->tail + count, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+/*
+ * create an output thread for the given device
+ */
+struct othread *
+othread_new(struct mididev *dev)
+{
+	struct othread *o;
+	struct sched_param param;
+	pthread_attr_t attr;
+	int err;
+
+	o = xmalloc(sizeof(struct othread), "othread");
+	o->dev = dev;
+	o->sleeping = 0;
+	o->quit = 0;
+	o->err = 0;
+	o->head = o->tail = 0;
+	pthread_mutex_init(&o->mtx, NULL);
+	pthread_cond_init(&o->cond, NULL);
+
+	/*
+	 * try to get real-time priority, if we can't (eg. not
+	 * enough privileges) use the default policy
+	 */
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &param);
+	err = pthread_create(&o->thread, &attr, othread_run, o);
+	pthread_attr_destroy(&attr);
+	if (err != 0) {
+		if (othread_debug)
+			log_puts("othread_new: no real-time priority\n");
+		err = pthread_create(&o->thread, NULL, othread_run, o);
+	}
+	if (err != 0) {
+		log_puts("othread_new: couldn't create thread\n");
+		pthread_cond_destroy(&o->cond);
+		pthread_mutex_destroy(&o->mtx);
+		xfree(o);
+		return NULL;
+	}
+	return o;
+}
+
+/*
+ * wait for the thread to send all pending data, then terminate it
+ */
+void
+othread_del(struct othread *o)
+{
+	__atomic_store_n(&o->quit, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_lock(&o->mtx);
+	pthread_cond_signal(&o->cond);
+	pthread_mutex_unlock(&o->mtx);
+	pthread_join(o->thread, NULL);
+	pthread_cond_destroy(&o->cond);
+	pthread_mutex_destroy(&o->mtx);
+	xfree(o);
+}
+
+/*
+ * queue the given bytes for sending. If there's not enough space in
+ * the ring (ie. the device is much slower than our output), fail with
+ * ENOBUFS, as if the write failed, so the main thread closes the
+ * device. Once failed, the bytes are discarded
+ */
+void
+othread_write(struct othread *o, unsigned char *data, unsigned count)
+{
+	unsigned head, avail;
+	int err;
+
+	if (__atomic_load_n(&o->err, __ATOMIC_SEQ_CST) != 0)
+		return;
+	head = o->head;
+	avail = OTHREAD_BUFLEN -
+	    (head - __atomic_load_n(&o->tail, __ATOMIC_ACQUIRE));
+	if (count > avail) {
+		if (othread_debug)
+			log_puts("othread_write: ring full\n");
+		err = 0;
+		__atomic_compare_exchange_n(&o->err, &err, ENOBUFS, 0,
+		    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+		othread_wakeup(o);
+		return;
+	}
+	while (count-- > 0)
+		o->buf[head++ & OTHREAD_MASK] = *data++;
+	__atomic_store_n(&o->head, head, __ATOMIC_SEQ_CST);
+	othread_wakeup(o);
+}
+
+/*
+ * return the errno of the write that failed in the thread, or 0 if
+ * none failed
+ */
+int
+othread_geterr(struct othread *o)
+{
+	return __atomic_load_n(&o->err, __ATOMIC_SEQ_CST);
+}
@@ -15,25 +15,145 @@
  */
 
 /*
- * a pool is a large memory block (the pool) that is split into
- * small blocks of equal size (pools entries). Its used for
- * fast allocation of pool entries. Free enties are on a singly
- * linked list
+ * a pool is a set of large memory blocks (the slabs) that are split
+ * into small blocks of equal size (pools entries). Its used for fast
+ * allocation of pool entries. Free entries of each slab are on a
+ * singly linked list.
+ *
+ * Slabs are aligned to their size, which allows to find the slab of
+ * any entry. Entries are allocated from partially used slabs first,
+ * so that slabs of unused entries can be freed. The pool is never
+ * exhausted: if there are no free entries, a new slab is allocated.
+ *
+ * To avoid calling malloc() on the real-time path, POOL_HEADROOM empty
+ * slabs are kept in reserve. The reserve is refilled (and extra empty
+ * slabs are freed) by pool_refill(), which is called by the mux
+ * before it goes to sleep.
  */
 
+#include <stdlib.h>
 #include "utils.h"
 #include "pool.h"
 
+struct poolslab {
+	struct poolslab *next, **prev;	/* list the slab is on */
+	struct poolent *free;		/* list of free entries */
+	unsigned used;			/* allocated entries */
+};
+
+/*
+ * size of the slab header, rounded so entries are aligned
+ */
+#define POOL_HDRSIZE	((sizeof(struct poolslab) + 15) & ~15)
+
+#define POOL_SLAB(o, e) ((struct poolslab *) \
+	((unsigned long)(e) & ~((unsigned long)(o)->slabsize - 1)))
+
 unsigned pool_debug = 0;
 
 /*
- * initialises a pool of "itemnum" elements of size "itemsize"
+ * if set, free empty slabs in excess of the capacity hint
+ */
+unsigned pool_shrink = 1;
+
+/*
+ * list of all pools, for pool_refill()
  */
+struct pool *pool_list = NULL;
+
 void
-pool_init(struct pool *o, char *name, unsigned itemsize, unsigned itemnum)
+pool_slablink(struct poolslab **list, struct poolslab *s)
 {
-	unsigned i;
+	s->next = *list;
+	s->prev = list;
+	if (s->next)
+		s->next->prev = &s->next;
+	*list = s;
+}
+
+void
+pool_slabunlink(struct poolslab *s)
+{
+	*s->prev = s->next;
+	if (s->next)
+		s->next->prev = s->prev;
+}
+
+/*
+ * allocate a new slab and put it on the list of empty slabs
+ */
+void
+pool_slabnew(struct pool *o)
+{
+	struct poolslab *s;
 	unsigned char *p;
+	unsigned i;
+	void *data = NULL;
+
+	if (posix_memalign(&data, o->slabsize, o->slabsize) != 0) {
+		log_puts("pool_slabnew(");
+		log_puts(o->name);
+		log_puts("): out of memory\n");
+		panic();
+	}
+	s = data;
+	s->free = NULL;
+	s->used = 0;
+
+	/*
+	 * create a linked list of all entries, so that the first
+	 * entry allocated is at the beginning of the slab
+	 */
+	p = (unsigned char *)data + POOL_HDRSIZE + o->slabnum * o->itemsize;
+	for (i = o->slabnum; i != 0; i--) {
+		p -= o->itemsize;
+		((struct poolent *)p)->next = s->free;
+		s->free = (struct poolent *)p;
+	}
+	pool_slablink(&o->empty, s);
+	o->nempty++;
+	o->nslabs++;
+	o->itemnum += o->slabnum;
+}
+
+/*
+ * free the given slab, it must be on the list of empty slabs
+ */
+void
+pool_slabdel(struct pool *o, struct poolslab *s)
+{
+	pool_slabunlink(s);
+	o->nempty--;
+	o->nslabs--;
+	o->itemnum -= o->slabnum;
+	free(s);
+}
+
+/*
+ * free all slabs of the given list
+ */
+void
+pool_slabfree(struct poolslab *s)
+{
+	struct poolslab *snext;
+
+	for (; s != NULL; s = snext) {
+		snext = s->next;
+		free(s);
+	}
+}
+
+/*
+ * initialises a pool of elements of size "itemsize"; "itemnum" is a
+ * capacity hint: the pool never shrinks below enough slabs to store
+ * "itemnum" elements. Only the reserve is allocated here, other
+ * slabs are allocated when needed, so memory usage is proportional
+ * to the actual number of elements
+ */
+void
+pool_init(struct pool *o, char *name, unsigned itemsize, unsigned itemnum)
+{
+	unsigned n;
 
 	/*
 	 * round item size to sizeof unsigned
@@ -44,43 +164,41 @@ pool_init(struct pool *o, char *name, unsigned itemsize, unsigned itemnum)
 	itemsize += sizeof(unsigned) - 1;
 	itemsize &= ~(sizeof(unsigned) - 1);
 
-	o->data = xmalloc(itemsize * itemnum, "pool");
-	if (!o->data) {
-		log_puts("pool_init(");
-		log_puts(name);
-		log_puts("): out of memory\n");
-		panic();
-	}
-	o->first = NULL;
+	/*
+	 * use slabs large enough to hold a reasonable number of items
+	 */
+	o->slabsize = POOL_SLABSIZE;
+	while (o->slabsize - POOL_HDRSIZE < 16 * itemsize)
+		o->slabsize *= 2;
+
+	o->partial = o->full = o->empty = NULL;
+	o->nslabs = 0;
+	o->nempty = 0;
+	o->itemnum = 0;
 	o->itemsize = itemsize;
-	o->itemnum = itemnum;
+	o->slabnum = (o->slabsize - POOL_HDRSIZE) / itemsize;
+	o->minslabs = (itemnum + o->slabnum - 1) / o->slabnum;
 	o->name = name;
-#ifdef POOL_DEBUG
 	o->maxused = 0;
 	o->used = 0;
 	o->newcnt = 0;
-#endif
-
-	/*
-	 * create a linked list of all entries
-	 */
-	p = o->data;
-	for (i = itemnum; i != 0; i--) {
-		((struct poolent *)p)->next = o->first;
-		o->first = (struct poolent *)p;
-		p += itemsize;
-		o->itemnum++;
-	}
+	for (n = POOL_HEADROOM; n > 0; n--)
+		pool_slabnew(o);
+	o->next = pool_list;
+	pool_list = o;
 }
 
-
 /*
  * free the given pool
  */
 void
 pool_done(struct pool *o)
 {
-	xfree(o->data);
+	struct pool **p;
+
+	for (p = &pool_list; *p != o; p = &(*p)->next)
+		; /* nothing */
+	*p = o->next;
 #ifdef POOL_DEBUG
 	if (o->used != 0) {
 		log_puts("pool_done(");
@@ -89,23 +207,45 @@ pool_done(struct pool *o)
 		log_putu(o->used);
 		log_puts(" items still allocated\n");
 	}
+#endif
 	if (pool_debug) {
 		log_puts("pool_done(");
 		log_puts(o->name);
 		log_puts("): using ");
-		log_putu((1023 + o->itemnum * o->itemsize) / 1024);
+		log_putu((1023 + o->nslabs * o->slabsize) / 1024);
 		log_puts("kB maxused = ");
-		log_putu(100 * o->maxused / o->itemnum);
-		log_puts("% allocs = ");
-		log_putu(100 * o->newcnt / o->itemnum);
-		log_puts("%\n");
+		log_putu(o->maxused);
+		log_puts(" allocs = ");
+		log_putu(o->newcnt);
+		log_puts("\n");
+	}
+	pool_slabfree(o->partial);
+	pool_slabfree(o->full);
+	pool_slabfree(o->empty);
+}
+
+/*
+ * make sure each pool has its reserve of empty slabs, and free extra
+ * empty slabs. This is not to be called on the real-time path
+ */
+void
+pool_refill(void)
+{
+	struct pool *o;
+
+	for (o = pool_list; o != NULL; o = o->next) {
+		while (o->nempty < POOL_HEADROOM)
+			pool_slabnew(o);
+		if (!pool_shrink)
+			continue;
+		while (o->nempty > POOL_HEADROOM && o->nslabs > o->minslabs)
+			pool_slabdel(o, o->empty);
 	}
-#endif
 }
 
 /*
  * allocate an entry from the pool: just unlink
- * it from the free list and return the pointer
+ * it from the free list of a slab and return the pointer
  */
 void *
 pool_new(struct pool *o)
@@ -114,28 +254,41 @@ pool_new(struct pool *o)
 	unsigned i;
 	unsigned char *buf;
 #endif
-
+	struct poolslab *s;
 	struct poolent *e;
 
-	if (!o->first) {
-		log_puts("pool_new(");
-		log_puts(o->name);
-		log_puts("): pool is empty\n");
-		panic();
+	s = o->partial;
+	if (s == NULL) {
+		if (o->empty == NULL) {
+			if (pool_debug) {
+				log_puts("pool_new(");
+				log_puts(o->name);
+				log_puts("): no headroom, growing\n");
+			}
+			pool_slabnew(o);
+		}
+		s = o->empty;
+		pool_slabunlink(s);
+		o->nempty--;
+		pool_slablink(&o->partial, s);
 	}
 
 	/*
 	 * unlink from the free list
 	 */
-	e = o->first;
-	o->first = e->next;
-
-#ifdef POOL_DEBUG
+	e = s->free;
+	s->free = e->next;
+	s->used++;
+	if (s->free == NULL) {
+		pool_slabunlink(s);
+		pool_slablink(&o->full, s);
+	}
 	o->newcnt++;
 	o->used++;
 	if (o->used > o->maxused)
 		o->maxused = o->used;
 
+#ifdef POOL_DEBUG
 	/*
 	 * overwrite the entry with garbage so any attempt to use
 	 * uninitialized memory will probably segfault
@@ -148,12 +301,13 @@ pool_new(struct pool *o)
 }
 
 /*
- * free an entry: just link it again on the free list
+ * free an entry: just link it again on the free list of its slab
  */
 void
 pool_del(struct pool *o, void *p)
 {
 	struct poolent *e = (struct poolent *)p;
+	struct poolslab *s = POOL_SLAB(o, p);
 #ifdef POOL_DEBUG
 	unsigned i;
 	unsigned char *buf;
@@ -168,7 +322,6 @@ pool_del(struct pool *o, void *p)
 		log_puts("): pool is full\n");
 		panic();
 	}
-	o->used--;
 
 	/*
 	 * overwrite the entry with garbage so any attempt to use a
@@ -178,9 +331,22 @@ pool_del(struct pool *o, void *p)
 	for (i = o->itemsize; i > 0; i--)
 		*(buf++) = 0xdf;
 #endif
+	o->used--;
+
 	/*
-	 * link on the free list
+	 * link on the free list of the slab, and move the slab to
+	 * the list corresponding to its new usage
 	 */
-	e->next = o->first;
-	o->first = e;
+	if (s->free == NULL) {
+		pool_slabunlink(s);
+		pool_slablink(&o->partial, s);
+	}
+	e->next = s->free;
+	s->free = e;
+	s->used--;
+	if (s->used == 0) {
+		pool_slabunlink(s);
+		pool_slablink(&o->empty, s);
+		o->nempty++;
+	}
 }
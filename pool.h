@@ -26,27 +26,50 @@ struct poolent {
 	struct poolent *next;
 };
 
+struct poolslab;
+
+/*
+ * minimum size of a slab, must be a power of 2
+ */
+#define POOL_SLABSIZE	0x4000
+
 /*
- * the pool is a linked list of 'itemnum' blocks of size
- * 'itemsize'. The pool name is for debugging prurposes only
+ * number of empty slabs kept in reserve, so that entries can be
+ * allocated without calling malloc()
+ */
+#define POOL_HEADROOM	1
+
+/*
+ * the pool is a set of slabs, each split into 'slabnum' blocks of size
+ * 'itemsize'. Slabs are added when the pool is exhausted and removed
+ * when they are empty. The pool name is for debugging prurposes only
  */
 struct pool {
-	unsigned char *data;	/* memory block of the pool */
-	struct poolent *first;	/* head of linked list */
-#ifdef POOL_DEBUG
+	struct pool *next;	/* list of all pools */
+	struct poolslab *partial; /* slabs with used and free entries */
+	struct poolslab *full;	/* slabs without free entries */
+	struct poolslab *empty;	/* slabs without used entries */
 	unsigned maxused;	/* max pool usage */
 	unsigned used;		/* current pool usage */
-	unsigned newcnt;	/* current items allocated */
-#endif
+	unsigned long newcnt;	/* number of items allocated so far */
+	unsigned nslabs;	/* total number of slabs */
+	unsigned nempty;	/* number of slabs on the 'empty' list */
+	unsigned minslabs;	/* slabs to keep, from the capacity hint */
 	unsigned itemnum;	/* total number of entries */
 	unsigned itemsize;	/* size of a sigle entry */
+	unsigned slabnum;	/* number of entries per slab */
+	unsigned slabsize;	/* size of a slab, a power of 2 */
 	char *name;		/* name of the pool */
 };
 
 void  pool_init(struct pool *, char *, unsigned, unsigned);
 void  pool_done(struct pool *);
+void  pool_refill(void);
 
 void *pool_new(struct pool *);
 void  pool_del(struct pool *, void *);
 
+extern unsigned pool_shrink;
+extern struct pool *pool_list;
+
 #endif /* MIDISH_POOL_H */
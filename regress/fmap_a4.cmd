@@ -0,0 +1,10 @@
+load "filt.sng"
+fmap {note {0 0} 36..59} {note {1 0} 36..59}
+fmap {note {0 0} 60..83} {note {1 1} 60..83}
+fmap {note {0 0} 48..71} {note {2 0} 48..71}
+fmap {any {0 1..3}} {any {2 1..3}}
+fmap {note {0 2} 60} {note {2 5} 60}
+fmap {ctl {0 0..15} 7} {ctl {1 0..15} 11}
+fmap {any {1 0..15}} {any {3 0..15}}
+fmap {note {1 4} 0..127} {note {4 4} 0..127}
+fchgin {any {1 4}} {any {1 5}}
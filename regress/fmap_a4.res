@@ -0,0 +1,15 @@
+{
+	songfilt f {
+		filt {
+			evmap any {1 0..15} > any {3 0..15}
+			evmap note {1 5} 0..127 > note {4 4} 0..127
+			evmap xctl {0 0..15} 7 > xctl {1 0..15} 11
+			evmap note {0 2} 60 > note {2 5} 60
+			evmap note {0 0} 48..71 > note {2 0} 48..71
+			evmap any {7 4..15} > any {3 0..11}
+			evmap any {7 9} > any {3 8}
+			evmap note {7 9} 0..65 > note {3 8} 10..75
+		}
+	}
+	curfilt f
+}
@@ -0,0 +1,7 @@
+load "tevmap.sng"
+thin {bend {0 0}} 10 64 0
+thin {ctl {0 0..15} 7} 20 128 50
+thin {cat {0 1}} 30 0 0
+thin {bend {0 0}} 15 32 0
+thin {cat {0 1}} 0 0 0
+g 0; sel 0; ct nil; ci nil; co nil
@@ -0,0 +1,19 @@
+tnew t
+for i in {0 1 2 3} {
+	for j in {0 4 8 12 16 20} {
+		taddev 0 $i $j {xctl {0 0} 7 $i * 24 + $j}
+	}
+}
+fnew f
+fmap {any {0 0}} {any {0 1}}
+fmap {any {0 2}} {any {0 3}}
+let n = 1
+for i in {1 2 3 4 5 6 7 8 9 10 11 12 13 14} {
+	g 0; sel $n; mdup 0
+	let n = $n * 2
+}
+g 0; sel $n; ttransp 1; tclr
+for i in {1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19} {
+	u
+}
+g 0; sel 0
@@ -0,0 +1,76 @@
+#
+# midish (unknown release)
+#
+{
+	format 1
+	tics_per_unit 96
+	tempo_factor 256
+	meta {
+		timesig 4 24
+		tempo 500000
+	}
+	songtrk t {
+		mute 0
+		track {
+			xctl {0 0} 7 0 # 0
+			4
+			xctl {0 0} 7 4 # 0
+			4
+			xctl {0 0} 7 8 # 0
+			4
+			xctl {0 0} 7 12 # 0
+			4
+			xctl {0 0} 7 16 # 0
+			4
+			xctl {0 0} 7 20 # 0
+			4
+			xctl {0 0} 7 24 # 0
+			4
+			xctl {0 0} 7 28 # 0
+			4
+			xctl {0 0} 7 32 # 0
+			4
+			xctl {0 0} 7 36 # 0
+			4
+			xctl {0 0} 7 40 # 0
+			4
+			xctl {0 0} 7 44 # 0
+			4
+			xctl {0 0} 7 48 # 0
+			4
+			xctl {0 0} 7 52 # 0
+			4
+			xctl {0 0} 7 56 # 0
+			4
+			xctl {0 0} 7 60 # 0
+			4
+			xctl {0 0} 7 64 # 0
+			4
+			xctl {0 0} 7 68 # 0
+			4
+			xctl {0 0} 7 72 # 0
+			4
+			xctl {0 0} 7 76 # 0
+			4
+			xctl {0 0} 7 80 # 0
+			4
+			xctl {0 0} 7 84 # 0
+			4
+			xctl {0 0} 7 88 # 0
+			4
+			xctl {0 0} 7 92 # 0
+		}
+	}
+	curtrk t
+	curpos 0
+	curlen 0
+	curquant 0
+	curev any {0..15 0..15}
+	metro {
+		mask	rec
+		lo	non {0 9} 68 90
+		hi	non {0 9} 67 127
+	}
+	tap off
+	tapev none
+}
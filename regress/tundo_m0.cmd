@@ -0,0 +1,3 @@
+load "tundo.sng"
+ct t; g 3; taddev 3 0 0 {xctl {0 0} 7 9}; g 1; sel 1; tclr; g 2; tins 1; u; u
+g 0; sel 0; ct nil; ci nil; co nil
@@ -0,0 +1,3 @@
+load "tundo.sng"
+ct t; g 1; sel 2; mdup 1; ttransp 1; u
+g 0; sel 0; ct nil; ci nil; co nil
@@ -0,0 +1,18 @@
+{
+	songtrk t {
+		track {
+			96
+			xctl {0 0} 7 1
+			96
+			xctl {0 0} 7 2
+			96
+			xctl {0 0} 7 3
+			96
+			xctl {0 0} 7 1
+			96
+			xctl {0 0} 7 2
+			96
+			xctl {0 0} 7 4
+		}
+	}
+}
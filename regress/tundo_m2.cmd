@@ -0,0 +1,3 @@
+load "quant.sng"
+ct t; g 0; sel 8; ev {note {0 0} 61}; ttransp 12; ev {note {0 0} 57..60}; ttransp 12; u
+g 0; sel 0; ct nil; ci nil; co nil; ev {any {0..15 0..15}}
@@ -0,0 +1,34 @@
+{
+	songtrk t {
+		track {
+			48
+			non {0 0} 60 100
+			48
+			noff {0 0} 60 100
+			49
+			non {0 0} 73 100
+			47
+			noff {0 0} 73 100
+			50
+			non {0 0} 62 100
+			46
+			noff {0 0} 62 100
+			51
+			non {0 0} 63 100
+			45
+			noff {0 0} 63 100
+			47
+			non {0 0} 59 100
+			49
+			noff {0 0} 59 100
+			46
+			non {0 0} 58 100
+			50
+			noff {0 0} 58 100
+			45
+			non {0 0} 57 100
+			51
+			noff {0 0} 57 100
+		}
+	}
+}
@@ -0,0 +1,3 @@
+load "tevmap.sng"
+ct t; g 0; sel 100; tvcurve 20
+g 0; sel 0; ct nil; ci nil; co nil
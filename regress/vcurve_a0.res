@@ -0,0 +1,54 @@
+{
+	songtrk t {
+		track {
+			48
+			non {0 0} 65 114
+			96
+			kat {0 0} 65 123
+			48
+			noff {0 0} 65 100
+			48
+			non {0 1} 66 114
+			96
+			kat {0 1} 66 123
+			48
+			noff {0 1} 66 100
+			48
+			ctl {0 0} 7 64
+			48
+			ctl {0 0} 7 65
+			48
+			ctl {0 1} 10 64
+			48
+			ctl {0 1} 10 65
+			48
+			cat {0 0} 64
+			48
+			cat {0 0} 0
+			48
+			cat {0 1} 64
+			48
+			cat {0 1} 0
+			48
+			xpc {0 0} 1 64
+			48
+			xpc {0 0} 2 65
+			48
+			nrpn {0 0} 1 64
+			48
+			nrpn {0 0} 2 65
+			48
+			rpn {0 0} 3 66
+			48
+			rpn {0 0} 4 67
+			48
+			bend {0 0} 0 0
+			48
+			bend {0 0} 0 64
+			48
+			bend {0 1} 63 63
+			48
+			bend {0 1} 0 64
+		}
+	}
+}
@@ -0,0 +1,6 @@
+load "filt.sng"
+fvcurve {note {7 0..1}} 30
+fvcurve {any {7 2}} (-20)
+ftransp {any {7 0..15}} 5
+fmap {note {0 0}} {note {3 0}}
+u
@@ -0,0 +1,13 @@
+{
+	songfilt f {
+		filt {
+			evmap any {7 4..15} > any {3 0..11}
+			evmap any {7 9} > any {3 8}
+			evmap note {7 9} 0..65 > note {3 8} 10..75
+			transp any {7 0..15} 5
+			vcurve note {7 0..1} 0..127 30
+			vcurve any {7 2} 108
+		}
+	}
+	curfilt f
+}
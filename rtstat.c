@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/*
+ * real-time statistics: fixed-bucket histograms of the time between
+ * timer call-backs, of how late ticks are processed and of how long
+ * it takes to process input. Values are in microseconds and the
+ * bucket of a value is given by its number of bits, so adding a
+ * value costs a few instructions and the histograms can be always
+ * enabled.
+ */
+
+#include "utils.h"
+#include "textio.h"
+#include "rtstat.h"
+
+struct rtstat rtstat_timer = {"timer", 0, 0, 0, {0}};
+struct rtstat rtstat_tick = {"tick", 0, 0, 0, {0}};
+struct rtstat rtstat_input = {"input", 0, 0, 0, {0}};
+
+/*
+ * add a value (in microseconds) to the histogram
+ */
+void
+rtstat_add(struct rtstat *o, unsigned long usec)
+{
+	unsigned i;
+
+	for (i = 0; i < RTSTAT_NBUCKETS - 1 && (1UL << i) <= usec; i++)
+		; /* nothing */
+	o->hist[i]++;
+	o->n++;
+	o->sum += usec;
+	if (o->max < usec)
+		o->max = usec;
+}
+
+/*
+ * clear the histogram
+ */
+void
+rtstat_reset(struct rtstat *o)
+{
+	unsigned i;
+
+	for (i = 0; i < RTSTAT_NBUCKETS; i++)
+		o->hist[i] = 0;
+	o->n = o->sum = o->max = 0;
+}
+
+/*
+ * print the histogram, each non-empty bucket is printed as
+ * the upper bound (in us) followed by the number of values
+ */
+void
+rtstat_output(struct rtstat *o, struct textout *f)
+{
+	unsigned i;
+
+	textout_putstr(f, o->name);
+	textout_putstr(f, " {\n");
+	textout_shiftright(f);
+
+	textout_putstr(f, "count ");
+	textout_putlong(f, o->n);
+	textout_putstr(f, "\n");
+	textout_putstr(f, "avg ");
+	textout_putlong(f, o->n > 0 ? o->sum / o->n : 0);
+	textout_putstr(f, "\n");
+	textout_putstr(f, "max ");
+	textout_putlong(f, o->max);
+	textout_putstr(f, "\n");
+
+	textout_putstr(f, "hist {\n");
+	textout_shiftright(f);
+	for (i = 0; i < RTSTAT_NBUCKETS; i++) {
+		if (o->hist[i] == 0)
+			continue;
+		if (i == RTSTAT_NBUCKETS - 1)
+			textout_putstr(f, "inf");
+		else
+			textout_putlong(f, 1UL << i);
+		textout_putstr(f, " ");
+		textout_putlong(f, o->hist[i]);
+		textout_putstr(f, "\n");
+	}
+	textout_shiftleft(f);
+	textout_putstr(f, "}\n");
+
+	textout_shiftleft(f);
+	textout_putstr(f, "}\n");
+}
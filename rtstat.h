@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2003-2010 Alexandre Ratchov <alex@caoua.org>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef MIDISH_RTSTAT_H
+#define MIDISH_RTSTAT_H
+
+/*
+ * number of histogram buckets, bucket 0 counts values of 0us,
+ * bucket i > 0 counts values in the [2^(i-1), 2^i) range. The last
+ * bucket counts everything above 2^(RTSTAT_NBUCKETS - 2), ie ~0.25s
+ */
+#define RTSTAT_NBUCKETS	20
+
+struct textout;
+
+struct rtstat {
+	char *name;			/* as displayed */
+	unsigned long n;		/* number of values */
+	unsigned long sum;		/* sum of values, in us */
+	unsigned long max;		/* largest value, in us */
+	unsigned long hist[RTSTAT_NBUCKETS];
+};
+
+void rtstat_add(struct rtstat *, unsigned long);
+void rtstat_reset(struct rtstat *);
+void rtstat_output(struct rtstat *, struct textout *);
+
+extern struct rtstat rtstat_timer, rtstat_tick, rtstat_input;
+
+#endif /* MIDISH_RTSTAT_H */
@@ -25,6 +25,7 @@
 #include "conv.h"
 #include "version.h"
 #include "cons.h"
+#include "norm.h"
 
 #define FORMAT_VERSION	1
 
@@ -219,18 +220,25 @@ track_output(struct track *t, struct textout *f)
 void
 filt_output(struct filt *o, struct textout *f)
 {
-	struct filtnode *s, *snext;
+	struct filtnode *s, **srcs;
 	struct filtnode *d;
+	unsigned i, n;
+
 	textout_putstr(f, "{\n");
 	textout_shiftright(f);
 
-	snext = 0;
-	for (;;) {
-		if (snext == o->map)
-			break;
-		for (s = o->map; s->next != snext; s = s->next) {
-			/* nothing */
-		}
+	/*
+	 * start with the last source, so when the filter is loaded,
+	 * sources are added before the smaller ones they include
+	 */
+	n = 0;
+	for (s = o->map; s != NULL; s = s->next)
+		n++;
+	srcs = xmalloc(n * sizeof(struct filtnode *), "filtsrcs");
+	for (i = n, s = o->map; s != NULL; s = s->next)
+		srcs[--i] = s;
+	for (i = 0; i < n; i++) {
+		s = srcs[i];
 		for (d = s->dstlist; d != NULL; d = d->next) {
 			textout_putstr(f, "evmap ");
 			evspec_output(&s->es, f);
@@ -238,8 +246,8 @@ filt_output(struct filt *o, struct textout *f)
 			evspec_output(&d->es, f);
 			textout_putstr(f, "\n");
 		}
-		snext = s;
 	}
+	xfree(srcs);
 	for (d = o->transp; d != NULL; d = d->next) {
 		textout_putstr(f, "transp ");
 		evspec_output(&d->es, f);
@@ -482,6 +490,7 @@ song_output(struct song *o, struct textout *f)
 	struct songchan *i;
 	struct songfilt *g;
 	struct songsx *s;
+	struct normthin *n;
 
 	textout_putstr(f, "{\n");
 	textout_shiftright(f);
@@ -586,6 +595,18 @@ song_output(struct song *o, struct textout *f)
 	evspec_output(&o->tap_evspec, f);
 	textout_putstr(f, "\n");
 
+	for (n = o->thinlist; n != NULL; n = n->next) {
+		textout_putstr(f, "thin ");
+		evspec_output(&n->es, f);
+		textout_putstr(f, " ");
+		textout_putlong(f, n->msec);
+		textout_putstr(f, " ");
+		textout_putlong(f, n->delta);
+		textout_putstr(f, " ");
+		textout_putlong(f, n->smooth);
+		textout_putstr(f, "\n");
+	}
+
 	textout_shiftleft(f);
 	textout_putstr(f, "}");
 }
@@ -1228,7 +1249,7 @@ load_track(struct load *o, struct track *t)
 				if (conv_packev(&slist, 0U,
 					CONV_XPC | CONV_NRPN | CONV_RPN,
 					&ev, &rev)) {
-					se = seqev_new();
+					se = seqev_new(t);
 					se->ev = rev;
 					seqev_ins(pos, se);
 				}
@@ -1977,7 +1998,7 @@ load_song(struct load *o, struct song *s)
 	struct songfilt *g;
 	struct songsx *l;
 	struct evspec es;
-	unsigned long num, num2;
+	unsigned long num, num2, num3;
 	int input;
 
 	if (!load_getsym(o))
@@ -2267,6 +2288,18 @@ load_song(struct load *o, struct song *s)
 				if (!load_nl(o))
 					return 0;
 				s->tap_evspec = es;
+			} else if (str_eq(o->strval, "thin")) {
+				if (!load_evspec(o, &es))
+					return 0;
+				if (!load_long(o, 0, NORM_THIN_MAXMSEC, &num))
+					return 0;
+				if (!load_long(o, 0, EV_MAXFINE, &num2))
+					return 0;
+				if (!load_long(o, 0, NORM_THIN_MAXSMOOTH, &num3))
+					return 0;
+				if (!load_nl(o))
+					return 0;
+				norm_thinset(&s->thinlist, &es, num, num2, num3);
 			} else
 				goto unknown;
 		} else {
@@ -734,7 +734,7 @@ smf_gettrack(struct smf *o, struct song *s, struct songtrk *t)
 			}
 			if (conv_packev(&slist, 0U,
 				CONV_XPC | CONV_NRPN | CONV_RPN, &ev, &rev)) {
-				se = seqev_new();
+				se = seqev_new(&t->track);
 				se->ev = rev;
 				seqev_ins(pos, se);
 			}
@@ -932,6 +932,14 @@ song_importsmf(char *filename)
 		song_fix1(o);
 	}
 
+	/*
+	 * events were moved out of the imported tracks
+	 */
+	SONG_FOREACH_TRK(o, t) {
+		track_compact(&t->track);
+	}
+	track_compact(&o->meta);
+
 
 	/*
 	 * TODO: move sysex messages into separate songsx
@@ -75,6 +75,7 @@ song_init(struct song *o)
 	o->sxlist = NULL;
 	o->undo = NULL;
 	o->undo_size = 0;
+	o->undo_jlast = NULL;
 	o->tics_per_unit = DEFAULT_TPU;
 	track_init(&o->meta);
 	track_init(&o->clip);
@@ -108,19 +109,21 @@ song_init(struct song *o)
 	o->curlen = 0;
 	o->curquant = 0;
 	o->loop = 0;
+	o->rendptr = NULL;
 	evspec_reset(&o->curev);
 	evspec_reset(&o->tap_evspec);
 	o->tap_evspec.cmd = EVSPEC_EMPTY;
 	o->tap_mode = 0;
+	o->thinlist = NULL;
 
 	/*
 	 * add default timesig/tempo so that setunit() works
 	 */
-	se = seqev_new();
+	se = seqev_new(&o->meta);
 	se->ev.cmd = EV_TEMPO;
 	se->ev.tempo_usec24 = TEMPO_TO_USEC24(DEFAULT_TEMPO, o->tpb);
 	seqev_ins(o->meta.first, se);
-	se = seqev_new();
+	se = seqev_new(&o->meta);
 	se->ev.cmd = EV_TIMESIG;
 	se->ev.timesig_beats = DEFAULT_BPM;
 	se->ev.timesig_tics = o->tics_per_unit / DEFAULT_BPM;
@@ -154,6 +157,7 @@ song_done(struct song *o)
 	track_done(&o->rec);
 	sysexlist_done(&o->recsx);
 	metro_done(&o->metro);
+	norm_thinclear(&o->thinlist);
 	if (o->undo != NULL) {
 		log_puts("undo data not freed\n");
 		panic();
@@ -239,6 +243,8 @@ song_channew(struct song *o, char *name, unsigned dev, unsigned ch, int input)
 			src.ch_min = src.ch_max = i->ch;
 			filt_mapnew(&c->filt->filt, &src, &dst);
 		}
+		if (mux_isopen)
+			filt_compile(&c->filt->filt);
 	}
 	song_setcurchan(o, c, input);
 	return c;
@@ -424,8 +430,11 @@ song_setcurfilt(struct song *o, struct songfilt *f)
 {
 	if (o->curfilt == f)
 		return;
-	if (mux_isopen)
+	if (mux_isopen) {
+		if (f != NULL && f->filt.cmap == NULL)
+			filt_compile(&f->filt);
 		norm_shut();
+	}
 	o->curfilt = f;
 	if (o->curout && o->curout->filt != f)
 		o->curout = NULL;
@@ -454,9 +463,8 @@ song_setcurchan(struct song *o, struct songchan *c, int input)
 unsigned
 song_endpos(struct song *o)
 {
-	struct seqptr *mp;
 	struct songtrk *t;
-	unsigned m, tpm, tpb, bpm, len, maxlen, delta;
+	unsigned len, maxlen, meas, beat, tic;
 
 	maxlen = 0;
 	SONG_FOREACH_TRK(o, t) {
@@ -464,25 +472,14 @@ song_endpos(struct song *o)
 		if (maxlen < len)
 			maxlen = len;
 	}
-	m = 0;
-	len = 0;
-	mp = seqptr_new(&o->meta);
-	while (len < maxlen) {
-		while (seqptr_evget(mp)) {
-			/* nothing */
-		}
-		seqptr_getsign(mp, &bpm, &tpb);
-		tpm = bpm * tpb;
-		delta = seqptr_skip(mp, tpm);
-		if (delta > 0) {
-			m += (maxlen - len + tpm - 1) / tpm;
-			break;
-		}
-		len += tpm;
-		m++;
-	}
-	seqptr_del(mp);
-	return m;
+
+	/*
+	 * round to the next measure
+	 */
+	track_findtic(&o->meta, maxlen, &meas, &beat, &tic);
+	if (beat > 0 || tic > 0)
+		meas++;
+	return meas;
 }
 
 void
@@ -618,7 +615,7 @@ song_loop_init(struct song *o)
 
 	SONG_FOREACH_TRK(o, t) {
 		t->loop_trackptr = seqptr_new(&t->track);
-		seqptr_skip(t->loop_trackptr, o->loop_tstart);
+		seqptr_locate(t->loop_trackptr, o->loop_tstart);
 
 		/*
 		 * Drop notes, as we don't restore them
@@ -807,6 +804,8 @@ song_ticskip(struct song *o)
 	SONG_FOREACH_TRK(o, i) {
 		neot |= seqptr_ticskip(i->trackptr, 1);
 	}
+	if (o->rendptr)
+		seqptr_ticput(o->rendptr, 1);
 	if (o->mode >= SONG_REC) {
 		if (o->playptr) {
 			seqptr_ticdel(o->playptr, 1, &o->rec_replay);
@@ -1155,7 +1154,7 @@ song_movecb(struct song *o)
 void
 song_evcb(struct song *o, struct ev *ev)
 {
-	struct ev filtout[FILT_MAXNRULES], rev;
+	struct ev filtout[FILT_MAXNOUT], rev;
 	struct state *s;
 	unsigned i, nev;
 	unsigned usec24;
@@ -1261,34 +1260,12 @@ song_sysexcb(struct song *o, struct sysex *sx)
 unsigned
 song_mtcpos(struct song *o, unsigned where, unsigned offs)
 {
-	struct seqptr *p;
-	unsigned delta, bpm, tpb, meas, beat, tick;
+	unsigned tic;
 	unsigned long long pos;
-	unsigned long usec24;
 
-	p = seqptr_new(&o->meta);
-	pos = 0;
-	meas = beat = tick = 0;
-
-	for (;;) {
-		seqptr_getsign(p, &bpm, &tpb);
-		seqptr_gettempo(p, &usec24);
-		delta = (where - meas) * bpm * tpb - beat * tpb - tick;
-		if (delta <= offs)
-			break;
-		delta -= offs;
-		if (!seqptr_eot(p)) {
-			delta = seqptr_ticskip(p, delta);
-			while (!seqptr_evget(p))
-				; /* nothing */
-		}
-		tick += delta;
-		beat += tick / tpb;
-		tick = tick % tpb;
-		meas += beat / bpm;
-		beat = beat % bpm;
-		pos += (unsigned long long)delta * usec24;
-	}
+	tic = track_findmeasure(&o->meta, where);
+	tic = (tic > offs) ? tic - offs : 0;
+	pos = track_tictime(&o->meta, tic);
 
 	/* round to frame */
 	pos -= pos % (24000000ULL / DEFAULT_FPS);
@@ -1296,7 +1273,6 @@ song_mtcpos(struct song *o, unsigned where, unsigned offs)
 	/* wrap every 24 hours */
 	pos = pos % (24000000ULL * 36000 * 24);
 
-	seqptr_del(p);
 	return pos / (24000000ULL / MTC_SEC);
 }
 
@@ -1312,17 +1288,12 @@ song_loc(struct song *o, unsigned how, unsigned where, unsigned offs)
 {
 	struct state *s;
 	struct songtrk *t;
-	unsigned maxdelta, delta;
-	unsigned bpm, tpb;
+	unsigned tic;
 	unsigned long long pos, endpos;
 	unsigned long usec24;
 
-	seqptr_del(o->metaptr);
-	o->metaptr = seqptr_new(&o->meta);
-
 	/* please gcc */
-	endpos = 0xdeadbeef;
-	maxdelta = 0xdeadbeef;
+	endpos = pos = 0;
 
 	/*
 	 * XXX: when not in LOC_MEAS and LOC_SPP modes, the MTC position
@@ -1331,57 +1302,29 @@ song_loc(struct song *o, unsigned how, unsigned where, unsigned offs)
 
 	switch (how) {
 	case SONG_LOC_MEAS:
+		tic = track_findmeasure(&o->meta, where);
+		o->abspos = (tic > offs) ? tic - offs : 0;
 		break;
 	case SONG_LOC_MTC:
 		endpos = (unsigned long long)where * (24000000 / MTC_SEC);
-		offs = 0;
+		o->abspos = track_findtime(&o->meta, endpos, &pos);
 		break;
 	case SONG_LOC_SPP:
 		where *= o->tics_per_unit / 16;
-		offs = 0;
+		o->abspos = where;
 		break;
 	default:
 		log_puts("song_loc: bad argument\n");
 		panic();
 	}
-	pos = 0;
-	o->abspos = 0;
-	o->measure = o->beat = o->tic = 0;
-
-	for (;;) {
-		seqptr_getsign(o->metaptr, &bpm, &tpb);
-		seqptr_gettempo(o->metaptr, &usec24);
-		switch (how) {
-		case SONG_LOC_MEAS:
-			maxdelta = (where - o->measure) * bpm * tpb
-			    - o->beat * tpb
-			    - o->tic;
-			break;
-		case SONG_LOC_MTC:
-			maxdelta = (endpos - pos) / usec24;
-			break;
-		case SONG_LOC_SPP:
-			maxdelta = where - o->abspos;
-			break;
-		}
-		if (maxdelta <= offs)
-			break;
-		maxdelta -= offs;
-		delta = seqptr_ticskip(o->metaptr, maxdelta);
-		s = seqptr_evget(o->metaptr);
-		if (s == NULL) {
-			/* XXX: integrate this in ticskip() & co */
-			statelist_outdate(&o->metaptr->statelist);
-			delta = maxdelta;
-		}
-		o->tic += delta;
-		o->beat += o->tic / tpb;
-		o->tic = o->tic % tpb;
-		o->measure += o->beat / bpm;
-		o->beat = o->beat % bpm;
-		o->abspos += delta;
-		pos += (unsigned long long)delta * usec24;
-	}
+	track_findtic(&o->meta, o->abspos, &o->measure, &o->beat, &o->tic);
+
+	/*
+	 * move the meta track to the current position
+	 */
+	seqptr_del(o->metaptr);
+	o->metaptr = seqptr_new(&o->meta);
+	seqptr_locate(o->metaptr, o->abspos);
 
 	/*
 	 * process all meta events of the current tick,
@@ -1390,6 +1333,7 @@ song_loc(struct song *o, unsigned how, unsigned where, unsigned offs)
 	 */
 	while (seqptr_evget(o->metaptr))
 		; /* nothing */
+	seqptr_gettempo(o->metaptr, &usec24);
 
 	o->complete = !seqptr_eot(o->metaptr);
 
@@ -1408,7 +1352,7 @@ song_loc(struct song *o, unsigned how, unsigned where, unsigned offs)
 		 * allocate and restore new states
 		 */
 		t->trackptr = seqptr_new(&t->track);
-		seqptr_skip(t->trackptr, o->abspos);
+		seqptr_locate(t->trackptr, o->abspos);
 		for (s = t->trackptr->statelist.first; s != NULL; s = s->next)
 			s->tag = 0;
 		song_confrestore(&t->trackptr->statelist,
@@ -1517,6 +1461,7 @@ song_gotocb(struct song *o, unsigned mtcpos)
 void
 song_setmode(struct song *o, unsigned newmode)
 {
+	struct songfilt *f;
 	struct songtrk *t;
 	unsigned oldmode;
 
@@ -1525,6 +1470,12 @@ song_setmode(struct song *o, unsigned newmode)
 	if (oldmode >= SONG_PLAY) {
 		mux_stopreq();
 	}
+
+	/*
+	 * in look-ahead mode ticks may be processed late, so don't
+	 * use it when recording: input must be recorded in real time
+	 */
+	mux_ahead = (newmode == SONG_PLAY && !mux_render) ? mux_lookahead : 0;
 	if (newmode < oldmode)
 		metro_setmode(&o->metro, newmode);
 	if (oldmode >= SONG_REC && newmode < SONG_REC)
@@ -1575,6 +1526,14 @@ song_setmode(struct song *o, unsigned newmode)
 		statelist_init(&o->rec_replay);
 		statelist_init(&o->rec_input);
 
+		/*
+		 * compile filters now, filt_do() must not allocate
+		 */
+		SONG_FOREACH_FILT(o, f) {
+			if (f->filt.cmap == NULL)
+				filt_compile(&f->filt);
+		}
+
 		mux_open();
 
 		/*
@@ -1654,6 +1613,44 @@ song_play(struct song *o)
 	}
 }
 
+/*
+ * play the song from the current position to its end, as fast as
+ * possible and without using devices. Everything that would be sent
+ * to the devices (including the channel configuration, the effect of
+ * filters and the metronome) is stored in the given track. Instead
+ * of sleeping, the clock is advanced to the next deadline of the mux
+ */
+void
+song_render(struct song *o, struct track *out)
+{
+	unsigned long delta;
+	unsigned m;
+
+	m = o->curpos;
+	o->rendptr = seqptr_new(out);
+	seqptr_ticput(o->rendptr, track_findmeasure(&o->meta, m));
+	mux_render = 1;
+	song_setmode(o, SONG_PLAY);
+	song_goto(o, m);
+	mux_startreq(0);
+	mux_flush();
+	while (!o->complete && mux_nexttimo(&delta))
+		mux_timercb(delta);
+	song_stop(o);
+	mux_render = 0;
+	seqptr_del(o->rendptr);
+	o->rendptr = NULL;
+}
+
+/*
+ * called when the mux outputs an event during song_render()
+ */
+void
+song_rendercb(struct song *o, struct ev *ev)
+{
+	(void)seqptr_evput(o->rendptr, ev);
+}
+
 /*
  * record the current track: initialise the midi/timer and start the
  * event loop
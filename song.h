@@ -33,6 +33,7 @@ struct songchan;
 struct songfilt;
 struct songsx;
 struct undo;
+struct normthin;
 
 struct songtrk {
 	struct name name;		/* identifier + list entry */
@@ -73,6 +74,7 @@ struct song {
 	struct name *sxlist;		/* list of system exclive banks */
 	struct undo *undo;		/* list of operation to undo */
 	unsigned undo_size;		/* size of all undo buffers */
+	struct undo *undo_jlast;	/* newest record in the journal */
 	unsigned tics_per_unit;		/* number of tics in an unit note */
 	unsigned tempo_factor;		/* tempo := tempo * factor / 256 */
 	struct songtrk *curtrk;		/* default track */
@@ -92,6 +94,7 @@ struct song {
 #define SONG_TAP_TEMPO	2
 	int tap_mode;			/* one of above */
 	int tap_cnt;			/* number of taps, -1 means done */
+	struct normthin *thinlist;	/* input thinning policies */
 
 	/*
 	 * clipboard
@@ -127,6 +130,8 @@ struct song {
 	unsigned loop_tstart;		/* loop start tick */
 	unsigned loop_tend;		/* loop end tick */
 	struct seqptr *loop_metaptr;	/* backup of metaptr */
+
+	struct seqptr *rendptr;		/* where to store rendered output */
 };
 
 extern char *song_tap_modestr[3];
@@ -198,6 +203,7 @@ void song_setmode(struct song *, unsigned);
 void song_goto(struct song *, unsigned);
 void song_record(struct song *);
 void song_play(struct song *);
+void song_render(struct song *, struct track *);
 void song_idle(struct song *);
 void song_stop(struct song *);
 
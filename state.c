@@ -26,8 +26,8 @@
  * state pool. In a typical performace, the maximum state list length
  * is roughly equal to the maximum sounding notes; the mean list
  * length is between 2 and 3 states and the maximum is between 10 and
- * 20 states. Currently we use a singly linked list, but for
- * performance reasons we shoud use a hash table in the future.
+ * 20 states. So we use a doubly linked list, and only if it gets long
+ * (eg. many controllers on many devices) states are hashed as well.
  *
  */
 
@@ -36,6 +36,7 @@
 #include "state.h"
 
 struct pool state_pool;
+struct pool statehash_pool;
 unsigned state_serial;
 
 void
@@ -43,11 +44,19 @@ state_pool_init(unsigned size)
 {
 	state_serial = 0;
 	pool_init(&state_pool, "state", sizeof(struct state), size);
+
+	/*
+	 * hash tables are allocated when lists grow, possibly on the
+	 * real-time path, so they come from a pool as well
+	 */
+	pool_init(&statehash_pool, "statehash",
+	    STATELIST_NHASH * sizeof(struct state *), 0);
 }
 
 void
 state_pool_done(void)
 {
+	pool_done(&statehash_pool);
 	pool_done(&state_pool);
 }
 
@@ -315,6 +324,8 @@ void
 statelist_init(struct statelist *o)
 {
 	o->first = NULL;
+	o->hash = NULL;
+	o->nstates = 0;
 	o->changed = 0;
 	o->serial = state_serial++;
 }
@@ -346,7 +357,10 @@ statelist_done(struct statelist *o)
 		statelist_rm(o, i);
 		state_del(i);
 	}
-
+	if (o->hash) {
+		pool_del(&statehash_pool, o->hash);
+		o->hash = NULL;
+	}
 }
 
 void
@@ -395,7 +409,82 @@ statelist_empty(struct statelist *o)
 }
 
 /*
- * add a state to the state list
+ * return the hash chain of the given event. Events matching the
+ * same frame (see ev_match()) must have the same hash
+ */
+unsigned
+statelist_hashev(struct ev *ev)
+{
+	unsigned h;
+
+	switch (ev->cmd) {
+	case EV_NON:
+	case EV_NOFF:
+	case EV_KAT:
+		h = ((EV_NON * 31 + ev->dev) * 16 + ev->ch) * 16411 +
+		    ev->note_num;
+		break;
+	case EV_BEND:
+	case EV_CAT:
+	case EV_XPC:
+		h = (ev->cmd * 31 + ev->dev) * 16 + ev->ch;
+		break;
+	case EV_TEMPO:
+	case EV_TIMESIG:
+		h = ev->cmd;
+		break;
+	default:
+		if (EV_ISSX(ev)) {
+			h = ev->cmd;
+			break;
+		}
+		h = ((ev->cmd * 31 + ev->dev) * 16 + ev->ch) * 16411 +
+		    ev->v0;
+	}
+	return ((h * 2654435761U) >> 16) & (STATELIST_NHASH - 1);
+}
+
+/*
+ * add a state to the head of its hash chain
+ */
+void
+statelist_hashadd(struct statelist *o, struct state *st)
+{
+	struct state **bucket;
+
+	bucket = &o->hash[statelist_hashev(&st->ev)];
+	st->hnext = *bucket;
+	st->hprev = bucket;
+	if (*bucket)
+		(*bucket)->hprev = &st->hnext;
+	*bucket = st;
+}
+
+/*
+ * hash all states of the list. Each state is appended to the tail of
+ * its chain, so states of a chain are in the same order as in the list
+ */
+void
+statelist_mkhash(struct statelist *o)
+{
+	struct state *i, **p;
+	unsigned n;
+
+	o->hash = pool_new(&statehash_pool);
+	for (n = 0; n < STATELIST_NHASH; n++)
+		o->hash[n] = NULL;
+	for (i = o->first; i != NULL; i = i->next) {
+		p = &o->hash[statelist_hashev(&i->ev)];
+		while (*p != NULL)
+			p = &(*p)->hnext;
+		i->hnext = NULL;
+		i->hprev = p;
+		*p = i;
+	}
+}
+
+/*
+ * add a state to the state list, the event of the state must be set
  */
 void
 statelist_add(struct statelist *o, struct state *st)
@@ -405,6 +494,11 @@ statelist_add(struct statelist *o, struct state *st)
 	if (o->first)
 		o->first->prev = &st->next;
 	o->first = st;
+	o->nstates++;
+	if (o->hash)
+		statelist_hashadd(o, st);
+	else if (o->nstates > STATELIST_HASHMAX)
+		statelist_mkhash(o);
 }
 
 /*
@@ -417,6 +511,16 @@ statelist_rm(struct statelist *o, struct state *st)
 	*st->prev = st->next;
 	if (st->next)
 		st->next->prev = st->prev;
+	o->nstates--;
+	if (o->hash) {
+		*st->hprev = st->hnext;
+		if (st->hnext)
+			st->hnext->hprev = st->hprev;
+		if (o->nstates < STATELIST_HASHMIN) {
+			pool_del(&statehash_pool, o->hash);
+			o->hash = NULL;
+		}
+	}
 }
 
 /*
@@ -427,6 +531,15 @@ struct state *
 statelist_lookup(struct statelist *o, struct ev *ev)
 {
 	struct state *i;
+
+	if (o->hash) {
+		i = o->hash[statelist_hashev(ev)];
+		for (; i != NULL; i = i->hnext) {
+			if (state_match(i, ev))
+				break;
+		}
+		return i;
+	}
 	for (i = o->first; i != NULL; i = i->next) {
 		if (state_match(i, ev)) {
 			break;
@@ -451,16 +564,22 @@ statelist_update(struct statelist *statelist, struct ev *ev)
 
 	phase = ev_phase(ev);
 
-	st = statelist->first;
+	/*
+	 * if the list is hashed, only iterate over the chain, it
+	 * contains all matching states in the same order as the list
+	 */
+	st = statelist->hash ?
+	    statelist->hash[statelist_hashev(ev)] : statelist->first;
 	for (;;) {
 		if (st == NULL) {
 			st = state_new();
+			st->ev = *ev;
 			st->flags = STATE_NEW;
 			statelist_add(statelist, st);
 			break;
 		}
 
-		stnext = st->next;
+		stnext = statelist->hash ? st->hnext : st->next;
 
 		if (state_match(st, ev)) {
 			if (!(st->phase == EV_PHASE_LAST) &&
@@ -479,6 +598,7 @@ statelist_update(struct statelist *statelist, struct ev *ev)
 	case EV_PHASE_FIRST:
 		if (st->flags != STATE_NEW) {
 			st = state_new();
+			st->ev = *ev;
 			st->flags = STATE_NEW | STATE_NESTED;
 			statelist_add(statelist, st);
 #ifdef STATE_DEBUG
@@ -25,6 +25,7 @@ struct statelist;
 
 struct state  {
 	struct state *next, **prev;	/* for statelist */
+	struct state *hnext, **hprev;	/* for statelist hash chains */
 	struct ev ev;			/* last event */
 	unsigned phase;			/* current phase (of the 'ev' field) */
 	/*
@@ -47,19 +48,38 @@ struct state  {
 	 * significances.
 	 */
 	unsigned tag;			/* user-defined tag */
-	unsigned tic;			/* absolute tic of the FIRST event */
+	unsigned val;			/* user-defined value */
+	unsigned tic;			/* user-defined tic or time */
 	struct seqev *pos;		/* pointer to the FIRST event */
 };
 
+/*
+ * number of hash chains, must be a power of 2
+ */
+#define STATELIST_NHASH		256
+
+/*
+ * the list is hashed when it has more than STATELIST_HASHMAX states
+ * and becomes a simple list again when it has less than
+ * STATELIST_HASHMIN states
+ */
+#define STATELIST_HASHMAX	32
+#define STATELIST_HASHMIN	8
+
 struct statelist {
 	/*
-	 * instead of a simple list, we should use a hash table here,
-	 * but statistics on real-life cases seem to show that lookups
-	 * are very fast thanks to the state ordering (average lookup
-	 * time is around 1-2 iterations for a common MIDI file), so
-	 * we keep using a simple list
+	 * statistics on real-life cases show that lookups in a simple
+	 * list are very fast thanks to the state ordering (average
+	 * lookup time is around 1-2 iterations for a common MIDI
+	 * file), so we use a simple list. However, on controller-heavy
+	 * or multi-device streams the list may contain hundreds of
+	 * states, in which case lookups use a hash table in addition
+	 * to the list. The list is always kept, so the states can be
+	 * iterated in the same order in both cases
 	 */
 	struct state *first;	/* head of the state list */
+	struct state **hash;	/* hash chains, or NULL if not hashed */
+	unsigned nstates;	/* number of states in the list */
 	unsigned changed;	/* if changed within this tick */
 	unsigned serial;	/* unique ID */
 #ifdef STATE_PROF
@@ -15,10 +15,10 @@
  */
 
 /*
- * trivial timeouts implementation.
+ * timeouts implementation based on a hierarchical timer wheel.
  *
  * A timeout is used to schedule the call of a routine (the callback)
- * there is a global list of timeouts that is processed inside the
+ * there is a global set of timeouts that is processed inside the
  * event loop ie mux_run(). Timeouts work as follows:
  *
  *	first the timo structure must be initialized with timo_set()
@@ -32,14 +32,129 @@
  *	the timeout can be aborted with timo_del(), it is OK to try to
  *	abort a timout that has expired
  *
+ * Pending timeouts are stored in the slots of a 3 level timer
+ * wheel, so that timo_add() and timo_del() don't depend on the number
+ * of pending timeouts. The slot of level 0 is chosen using the
+ * expiration "tick" (ie. the expiration time divided by 2^TIMO_SHIFT)
+ * if it's within a turn of the current tick. Otherwise the timeout
+ * is stored in the level 1 (or level 2) slot and is moved ("cascaded")
+ * to a lower level when the wheel enters the corresponding slot.
+ *
+ * Timeouts are called in the order of their expiration tick; the
+ * order of timeouts expiring within the same tick is unspecified.
  */
 
+#include <limits.h>
 #include "utils.h"
 #include "timo.h"
 
+#define TIMO_TICKMASK	((1U << (32 - TIMO_SHIFT)) - 1)
+
 unsigned timo_debug = 0;
-struct timo *timo_queue;
+struct timo *timo_wheel0[TIMO_NSLOTS0];
+struct timo *timo_wheel1[TIMO_NSLOTS1];
+struct timo *timo_wheel2[TIMO_NSLOTS2];
+unsigned timo_curtick;
 unsigned timo_abstime;
+unsigned timo_ncalls;
+
+/*
+ * insert the given timeout at the head of the given slot
+ */
+static void
+timo_link(struct timo **slot, struct timo *o)
+{
+	o->next = *slot;
+	o->prev = slot;
+	if (*slot)
+		(*slot)->prev = &o->next;
+	*slot = o;
+}
+
+/*
+ * remove the given timeout from its slot
+ */
+static void
+timo_unlink(struct timo *o)
+{
+	*o->prev = o->next;
+	if (o->next)
+		o->next->prev = o->prev;
+}
+
+/*
+ * store the timeout in the slot corresponding to its expiration
+ * time relative to the current tick
+ */
+static void
+timo_insert(struct timo *o)
+{
+	unsigned tick, delta;
+
+	tick = o->val >> TIMO_SHIFT;
+	delta = (tick - timo_curtick) & TIMO_TICKMASK;
+	if (delta < TIMO_NSLOTS0) {
+		timo_link(&timo_wheel0[tick & (TIMO_NSLOTS0 - 1)], o);
+	} else if (delta < TIMO_NSLOTS0 * TIMO_NSLOTS1) {
+		tick >>= TIMO_BITS0;
+		timo_link(&timo_wheel1[tick & (TIMO_NSLOTS1 - 1)], o);
+	} else {
+		tick >>= TIMO_BITS0 + TIMO_BITS1;
+		timo_link(&timo_wheel2[tick & (TIMO_NSLOTS2 - 1)], o);
+	}
+}
+
+/*
+ * move all timeouts of the given slot to lower levels
+ */
+static void
+timo_cascade(struct timo **slot)
+{
+	struct timo *o;
+
+	while ((o = *slot) != NULL) {
+		timo_unlink(o);
+		timo_insert(o);
+	}
+}
+
+/*
+ * call expired timeouts of the current tick, keep ones that
+ * are not expired yet
+ */
+static void
+timo_expire(void)
+{
+	struct timo **slot, *list, *o;
+	int diff;
+
+	/*
+	 * detach the slot, so callbacks may add/delete
+	 * timeouts freely while we're iterating
+	 */
+	slot = &timo_wheel0[timo_curtick & (TIMO_NSLOTS0 - 1)];
+	list = *slot;
+	if (list == NULL)
+		return;
+	list->prev = &list;
+	*slot = NULL;
+	while ((o = list) != NULL) {
+		timo_unlink(o);
+		/*
+		 * there is no overflow here because + and - are
+		 * modulo 2^32, they are the same for both signed and
+		 * unsigned integers
+		 */
+		diff = o->val - timo_abstime;
+		if (diff > 0) {
+			timo_link(slot, o);
+			continue;
+		}
+		o->set = 0;
+		timo_ncalls++;
+		o->cb(o->arg);
+	}
+}
 
 /*
  * initialise a timeout structure, arguments are callback and argument
@@ -60,10 +175,6 @@ timo_set(struct timo *o, void (*cb)(void *), void *arg)
 void
 timo_add(struct timo *o, unsigned delta)
 {
-	struct timo **i;
-	unsigned val;
-	int diff;
-
 #ifdef TIMO_DEBUG
 	if (o->set) {
 		log_puts("timo_add: already set\n");
@@ -74,17 +185,9 @@ timo_add(struct timo *o, unsigned delta)
 		panic();
 	}
 #endif
-	val = timo_abstime + delta;
-	for (i = &timo_queue; *i != NULL; i = &(*i)->next) {
-		diff = (*i)->val - val;
-		if (diff > 0) {
-			break;
-		}
-	}
 	o->set = 1;
-	o->val = val;
-	o->next = *i;
-	*i = o;
+	o->val = timo_abstime + delta;
+	timo_insert(o);
 }
 
 /*
@@ -93,17 +196,13 @@ timo_add(struct timo *o, unsigned delta)
 void
 timo_del(struct timo *o)
 {
-	struct timo **i;
-
-	for (i = &timo_queue; *i != NULL; i = &(*i)->next) {
-		if (*i == o) {
-			*i = o->next;
-			o->set = 0;
-			return;
-		}
+	if (!o->set) {
+		if (timo_debug)
+			log_puts("timo_del: not found\n");
+		return;
 	}
-	if (timo_debug)
-		log_puts("timo_del: not found\n");
+	timo_unlink(o);
+	o->set = 0;
 }
 
 /*
@@ -114,8 +213,7 @@ timo_del(struct timo *o)
 void
 timo_update(unsigned delta)
 {
-	struct timo *to;
-	int diff;
+	unsigned tick;
 
 	/*
 	 * update time reference
@@ -123,22 +221,86 @@ timo_update(unsigned delta)
 	timo_abstime += delta;
 
 	/*
-	 * remove from the queue and run expired timeouts
+	 * walk through all ticks up to the current one, cascading
+	 * higher levels as their slots are entered
 	 */
-	while (timo_queue != NULL) {
-		/*
-		 * there is no overflow here because + and - are
-		 * modulo 2^32, they are the same for both signed and
-		 * unsigned integers
-		 */
-		diff = timo_queue->val - timo_abstime;
-		if (diff > 0)
+	tick = timo_abstime >> TIMO_SHIFT;
+	for (;;) {
+		timo_expire();
+		if (timo_curtick == tick)
 			break;
-		to = timo_queue;
-		timo_queue = to->next;
-		to->set = 0;
-		to->cb(to->arg);
+		timo_curtick = (timo_curtick + 1) & TIMO_TICKMASK;
+		if ((timo_curtick & (TIMO_NSLOTS0 - 1)) != 0)
+			continue;
+		if ((timo_curtick & (TIMO_NSLOTS0 * TIMO_NSLOTS1 - 1)) == 0) {
+			timo_cascade(&timo_wheel2[(timo_curtick >>
+				(TIMO_BITS0 + TIMO_BITS1)) &
+				(TIMO_NSLOTS2 - 1)]);
+		}
+		timo_cascade(&timo_wheel1[(timo_curtick >> TIMO_BITS0) &
+			(TIMO_NSLOTS1 - 1)]);
+	}
+}
+
+/*
+ * store in 'rdelta' the time until the next timeout expires, and
+ * return 1. If no timeout is scheduled, return 0. Timeouts stored
+ * in level 1 and 2 slots are not examined: the start of the slot is
+ * used instead, so the returned time may be shorter than the actual
+ * one, but never longer.
+ */
+unsigned
+timo_next(unsigned *rdelta)
+{
+	struct timo *o;
+	unsigned i, tick, found, diff, min;
+
+	found = 0;
+	min = UINT_MAX;
+	for (i = 0; i < TIMO_NSLOTS0; i++) {
+		tick = timo_curtick + i;
+		o = timo_wheel0[tick & (TIMO_NSLOTS0 - 1)];
+		if (o == NULL)
+			continue;
+		for (; o != NULL; o = o->next) {
+			/*
+			 * level 0 timeouts are close, so the difference
+			 * is negative only if the timeout is overdue
+			 */
+			diff = o->val - timo_abstime;
+			if ((int)diff < 0)
+				diff = 0;
+			if (min > diff)
+				min = diff;
+		}
+		found = 1;
+		break;
+	}
+	for (i = 1; i <= TIMO_NSLOTS1; i++) {
+		tick = (timo_curtick >> TIMO_BITS0) + i;
+		if (timo_wheel1[tick & (TIMO_NSLOTS1 - 1)] == NULL)
+			continue;
+		diff = (tick << (TIMO_BITS0 + TIMO_SHIFT)) - timo_abstime;
+		if (min > diff)
+			min = diff;
+		found = 1;
+		break;
 	}
+	for (i = 1; i <= TIMO_NSLOTS2; i++) {
+		tick = (timo_curtick >> (TIMO_BITS0 + TIMO_BITS1)) + i;
+		if (timo_wheel2[tick & (TIMO_NSLOTS2 - 1)] == NULL)
+			continue;
+		diff = (tick << (TIMO_BITS0 + TIMO_BITS1 + TIMO_SHIFT)) -
+		    timo_abstime;
+		if (min > diff)
+			min = diff;
+		found = 1;
+		break;
+	}
+	if (!found)
+		return 0;
+	*rdelta = min;
+	return 1;
 }
 
 /*
@@ -147,8 +309,17 @@ timo_update(unsigned delta)
 void
 timo_init(void)
 {
-	timo_queue = NULL;
+	unsigned i;
+
+	for (i = 0; i < TIMO_NSLOTS0; i++)
+		timo_wheel0[i] = NULL;
+	for (i = 0; i < TIMO_NSLOTS1; i++)
+		timo_wheel1[i] = NULL;
+	for (i = 0; i < TIMO_NSLOTS2; i++)
+		timo_wheel2[i] = NULL;
 	timo_abstime = 0;
+	timo_curtick = 0;
+	timo_ncalls = 0;
 }
 
 /*
@@ -157,9 +328,22 @@ timo_init(void)
 void
 timo_done(void)
 {
-	if (timo_queue != NULL) {
-		log_puts("timo_done: timo_queue not empty!\n");
-		panic();
+	unsigned i;
+
+	for (i = 0; i < TIMO_NSLOTS0; i++) {
+		if (timo_wheel0[i] != NULL)
+			goto bad;
+	}
+	for (i = 0; i < TIMO_NSLOTS1; i++) {
+		if (timo_wheel1[i] != NULL)
+			goto bad;
+	}
+	for (i = 0; i < TIMO_NSLOTS2; i++) {
+		if (timo_wheel2[i] != NULL)
+			goto bad;
 	}
-	timo_queue = (struct timo *)0xdeadbeef;
+	return;
+bad:
+	log_puts("timo_done: timo_queue not empty!\n");
+	panic();
 }
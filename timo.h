@@ -17,9 +17,25 @@
 #ifndef MIDISH_TIMO_H
 #define MIDISH_TIMO_H
 
+/*
+ * the timer wheel has 3 levels; each slot of level 0 covers
+ * 2^TIMO_SHIFT 24-th of microseconds (~42us), each slot of level 1
+ * covers a full turn of level 0 (~11ms) and each slot of level 2
+ * covers a full turn of level 1 (~2.8s). Level 2 covers the full
+ * 32-bit range of timo_abstime.
+ */
+#define TIMO_SHIFT	10
+#define TIMO_BITS0	8
+#define TIMO_BITS1	8
+#define TIMO_BITS2	(32 - TIMO_SHIFT - TIMO_BITS0 - TIMO_BITS1)
+#define TIMO_NSLOTS0	(1 << TIMO_BITS0)
+#define TIMO_NSLOTS1	(1 << TIMO_BITS1)
+#define TIMO_NSLOTS2	(1 << TIMO_BITS2)
+
 struct timo {
-	struct timo *next;
-	unsigned val;			/* time to wait before the callback */
+	struct timo *next;		/* next in the wheel slot */
+	struct timo **prev;		/* ptr to 'next' of previous */
+	unsigned val;			/* absolute expiration time */
 	unsigned set;			/* true if the timeout is set */
 	void (*cb)(void *arg);		/* routine to call on expiration */
 	void *arg;			/* argument to give to 'cb' */
@@ -29,9 +45,11 @@ void timo_set(struct timo *, void (*)(void *), void *);
 void timo_add(struct timo *, unsigned);
 void timo_del(struct timo *);
 void timo_update(unsigned);
+unsigned timo_next(unsigned *);
 void timo_init(void);
 void timo_done(void);
 
 extern unsigned timo_abstime;
+extern unsigned timo_ncalls;
 
 #endif /* MIDISH_TIMO_H */
@@ -29,35 +29,245 @@
  *
  */
 
+#include <stddef.h>
+#include <stdlib.h>
 #include "utils.h"
-#include "pool.h"
 #include "track.h"
+#include "pool.h"
+
+/*
+ * events of a track are allocated from the chunks of the track,
+ * rather than from a global pool, so events of the same track are
+ * close to each other in memory. Within a chunk, events that were
+ * never used are allocated in increasing address order, so appending
+ * events (as recording, loading files or rewriting tracks do) stores
+ * them contiguously. Chunks are aligned to their size, which allows to
+ * find the chunk of any event.
+ *
+ * An event may be moved to another track (eg. with track_swap() or
+ * by frame routines), in which case its chunk remains owned by the
+ * original track. If the owner is destroyed, its remaining chunks
+ * are detached and freed once all their events are freed.
+ *
+ * Empty chunks are kept on a free list for reuse. The free list is
+ * refilled by seqev_pool_refill(), called by the mux before it goes to
+ * sleep, so normally no memory is allocated on the real-time path.
+ */
+struct seqev_chunk {
+	struct seqev_chunk *next, **prev;	/* owner's list */
+	struct track *owner;			/* track, or NULL if detached */
+	struct seqev *free;			/* list of free events */
+	unsigned used;				/* allocated events */
+	unsigned bump;				/* events never allocated */
+	struct seqev evs[1];			/* actually SEQEV_CHUNKLEN */
+};
+
+#define SEQEV_CHUNKLEN \
+	((SEQEV_CHUNKSIZE - offsetof(struct seqev_chunk, evs)) / \
+	sizeof(struct seqev))
+
+#define SEQEV_CHUNK(se) \
+	((struct seqev_chunk *)((unsigned long)(se) & ~(SEQEV_CHUNKSIZE - 1)))
+
+/*
+ * number of empty chunks kept in reserve, so that events can be
+ * allocated without calling malloc()
+ */
+#define SEQEV_HEADROOM	4
 
-struct pool seqev_pool;
+struct seqev_chunk *seqev_chunk_freelist;
+unsigned seqev_nfree;		/* chunks on the free list */
+unsigned seqev_minchunks;	/* don't free chunks below this */
+
+/*
+ * usage statistics, for the meminfo command
+ */
+unsigned seqev_nchunks;		/* chunks allocated, free ones included */
+unsigned seqev_used;		/* events allocated */
+unsigned seqev_maxused;		/* max of the above */
 
+/*
+ * allocate a new chunk
+ */
+struct seqev_chunk *
+seqev_chunk_alloc(void)
+{
+	void *p = NULL;
+
+	if (posix_memalign(&p, SEQEV_CHUNKSIZE, SEQEV_CHUNKSIZE) != 0) {
+		log_puts("seqev_chunk_alloc: out of memory\n");
+		panic();
+	}
+	seqev_nchunks++;
+	return p;
+}
+
+/*
+ * get an empty chunk, from the free list if possible
+ */
+struct seqev_chunk *
+seqev_chunk_new(void)
+{
+	struct seqev_chunk *c;
+
+	c = seqev_chunk_freelist;
+	if (c == NULL)
+		return seqev_chunk_alloc();
+	seqev_chunk_freelist = c->next;
+	seqev_nfree--;
+	return c;
+}
+
+/*
+ * put an empty chunk on the free list
+ */
+void
+seqev_chunk_del(struct seqev_chunk *c)
+{
+	c->next = seqev_chunk_freelist;
+	seqev_chunk_freelist = c;
+	seqev_nfree++;
+}
+
+/*
+ * link the chunk at the beginning of the given list
+ */
+void
+seqev_chunk_link(struct seqev_chunk **list, struct seqev_chunk *c)
+{
+	c->next = *list;
+	c->prev = list;
+	if (c->next)
+		c->next->prev = &c->next;
+	*list = c;
+}
+
+void
+seqev_chunk_unlink(struct seqev_chunk *c)
+{
+	*c->prev = c->next;
+	if (c->next)
+		c->next->prev = c->prev;
+	c->prev = NULL;
+}
+
+/*
+ * initialize the free list of chunks; "size" is a capacity hint: the
+ * free list is not shrunk below enough chunks to store "size"
+ * events. Only the reserve is allocated here, other chunks are
+ * allocated as tracks grow
+ */
 void
 seqev_pool_init(unsigned size)
 {
-	pool_init(&seqev_pool, "seqev", sizeof(struct seqev), size);
+	unsigned n;
+
+	seqev_minchunks = (size + SEQEV_CHUNKLEN - 1) / SEQEV_CHUNKLEN;
+	for (n = SEQEV_HEADROOM; n > 0; n--)
+		seqev_chunk_del(seqev_chunk_alloc());
+}
+
+/*
+ * make sure the reserve of chunks is full, and free extra chunks. This
+ * is not to be called on the real-time path
+ */
+void
+seqev_pool_refill(void)
+{
+	struct seqev_chunk *c;
+
+	while (seqev_nfree < SEQEV_HEADROOM)
+		seqev_chunk_del(seqev_chunk_alloc());
+	if (!pool_shrink)
+		return;
+	while (seqev_nfree > SEQEV_HEADROOM &&
+	    seqev_nchunks > seqev_minchunks) {
+		c = seqev_chunk_freelist;
+		seqev_chunk_freelist = c->next;
+		seqev_nfree--;
+		seqev_nchunks--;
+		free(c);
+	}
 }
 
 void
 seqev_pool_done(void)
 {
-	pool_done(&seqev_pool);
+	struct seqev_chunk *c;
+
+	while ((c = seqev_chunk_freelist) != NULL) {
+		seqev_chunk_freelist = c->next;
+		seqev_nfree--;
+		seqev_nchunks--;
+		free(c);
+	}
 }
 
+/*
+ * return the number of events that fit in the allocated chunks
+ */
+unsigned
+seqev_poolsize(void)
+{
+	return seqev_nchunks * SEQEV_CHUNKLEN;
+}
 
+/*
+ * allocate an event from the chunks of the given track
+ */
 struct seqev *
-seqev_new(void)
+seqev_new(struct track *t)
 {
-	return (struct seqev *)pool_new(&seqev_pool);
+	struct seqev_chunk *c;
+	struct seqev *se;
+
+	c = t->chunks;
+	if (c == NULL) {
+		c = seqev_chunk_new();
+		c->owner = t;
+		c->free = NULL;
+		c->used = 0;
+		c->bump = 0;
+		seqev_chunk_link(&t->chunks, c);
+	}
+	if (c->free) {
+		se = c->free;
+		c->free = se->next;
+	} else
+		se = &c->evs[c->bump++];
+	c->used++;
+	if (++seqev_used > seqev_maxused)
+		seqev_maxused = seqev_used;
+	if (c->free == NULL && c->bump == SEQEV_CHUNKLEN) {
+		seqev_chunk_unlink(c);
+		seqev_chunk_link(&t->full, c);
+	}
+	return se;
 }
 
+/*
+ * free the given event; its chunk becomes the first one to allocate
+ * from, so the free event is reused for the next insertion
+ */
 void
 seqev_del(struct seqev *se)
 {
-	pool_del(&seqev_pool, se);
+	struct seqev_chunk *c = SEQEV_CHUNK(se);
+
+	se->next = c->free;
+	c->free = se;
+	c->used--;
+	seqev_used--;
+	if (c->owner == NULL) {
+		if (c->used == 0)
+			seqev_chunk_del(c);
+		return;
+	}
+	seqev_chunk_unlink(c);
+	if (c->used == 0)
+		seqev_chunk_del(c);
+	else
+		seqev_chunk_link(&c->owner->chunks, c);
 }
 
 void
@@ -68,6 +278,16 @@ seqev_dump(struct seqev *i)
 	ev_log(&i->ev);
 }
 
+/*
+ * set the owner of all chunks of the given list
+ */
+void
+track_chunkown(struct seqev_chunk *c, struct track *owner)
+{
+	for (; c != NULL; c = c->next)
+		c->owner = owner;
+}
+
 /*
  * initialise the track
  */
@@ -79,6 +299,11 @@ track_init(struct track *o)
 	o->eot.next = NULL;
 	o->eot.prev = &o->first;
 	o->first = &o->eot;
+	o->idx = NULL;
+	o->tmap = NULL;
+	o->chunks = NULL;
+	o->full = NULL;
+	o->undo = NULL;
 }
 
 /*
@@ -89,10 +314,17 @@ track_done(struct track *o)
 {
 	struct seqev *i, *inext;
 
+	track_touch(o);
 	for (i = o->first;  i != &o->eot;  i = inext) {
 		inext = i->next;
 		seqev_del(i);
 	}
+
+	/*
+	 * detach chunks containing events moved to other tracks
+	 */
+	track_chunkown(o->chunks, NULL);
+	track_chunkown(o->full, NULL);
 #ifdef TRACK_DEBUG
 	o->first = (void *)0xdeadbeef;
 #endif
@@ -134,6 +366,10 @@ track_isempty(struct track *o)
 void
 track_chomp(struct track *o)
 {
+	if (o->undo)
+		track_touchat(o, track_numtic(o));
+	else
+		track_touch(o);
 	o->eot.delta = 0;
 }
 
@@ -143,9 +379,27 @@ track_chomp(struct track *o)
 void
 track_shift(struct track *o, unsigned ntics)
 {
+	track_touch(o);
 	o->first->delta += ntics;
 }
 
+/*
+ * swap two lists of chunks
+ */
+void
+track_chunkswap(struct seqev_chunk **l1, struct seqev_chunk **l2)
+{
+	struct seqev_chunk *c;
+
+	c = *l1;
+	*l1 = *l2;
+	*l2 = c;
+	if (*l1)
+		(*l1)->prev = l1;
+	if (*l2)
+		(*l2)->prev = l2;
+}
+
 /*
  * swap contents of two tracks
  */
@@ -154,6 +408,9 @@ track_swap(struct track *t1, struct track *t2)
 {
 	struct seqev *se, eot;
 
+	track_touch(t1);
+	track_touch(t2);
+
 	/* swap list of events */
 	se = t1->first;
 	t1->first = t2->first;
@@ -169,6 +426,106 @@ track_swap(struct track *t1, struct track *t2)
 	/* fix references to eot events */
 	*t1->eot.prev = &t1->eot;
 	*t2->eot.prev = &t2->eot;
+
+	/* swap chunks, as they follow events */
+	track_chunkswap(&t1->chunks, &t2->chunks);
+	track_chunkswap(&t1->full, &t2->full);
+	track_chunkown(t1->chunks, t1);
+	track_chunkown(t1->full, t1);
+	track_chunkown(t2->chunks, t2);
+	track_chunkown(t2->full, t2);
+}
+
+/*
+ * if less than half of the space of the chunks of the track is used
+ * (eg. after many events were moved to other tracks), move the events
+ * into fresh chunks, so they are contiguous again and the old chunks
+ * can be freed. Events are reallocated, so there must be no pointers
+ * to them, other than the event list itself. Not to be called on the
+ * real-time path
+ */
+void
+track_compact(struct track *o)
+{
+	struct seqev_chunk *c;
+	struct seqev *se, *ne;
+	unsigned nchunks;
+
+	nchunks = 0;
+	for (c = o->chunks; c != NULL; c = c->next)
+		nchunks++;
+	for (c = o->full; c != NULL; c = c->next)
+		nchunks++;
+	if (nchunks <= 1 || track_numev(o) >= nchunks * SEQEV_CHUNKLEN / 2)
+		return;
+	track_idxfree(o);
+
+	/*
+	 * detach the old chunks, they are freed as their events are
+	 */
+	track_chunkown(o->chunks, NULL);
+	track_chunkown(o->full, NULL);
+	o->chunks = o->full = NULL;
+	for (se = o->first; se != &o->eot; se = ne->next) {
+		ne = seqev_new(o);
+		ne->delta = se->delta;
+		ne->ev = se->ev;
+		ne->next = se->next;
+		ne->prev = se->prev;
+		*ne->prev = ne;
+		ne->next->prev = &ne->next;
+		seqev_del(se);
+	}
+}
+
+/*
+ * must be called before the track is modified: free the seek index,
+ * as it contains pointers to events and states that may become
+ * invalid, and the tempo map
+ */
+void
+track_touch(struct track *o)
+{
+	track_touchat(o, 0);
+}
+
+/*
+ * same as track_touch(), but only events at or after the given tic
+ * will be modified, so if undo data is being saved, earlier events
+ * need not be saved
+ */
+void
+track_touchat(struct track *o, unsigned tic)
+{
+	if (o->undo)
+		track_undotouch(o, tic);
+	if (o->tmap) {
+		xfree(o->tmap->ents);
+		xfree(o->tmap);
+		o->tmap = NULL;
+	}
+	track_idxfree(o);
+}
+
+/*
+ * free the seek index, if any
+ */
+void
+track_idxfree(struct track *o)
+{
+	struct track_idx *idx = o->idx;
+	unsigned i;
+
+	if (idx == NULL)
+		return;
+	for (i = 0; i < idx->n; i++) {
+		if (idx->ckpts[i].states)
+			xfree(idx->ckpts[i].states);
+	}
+	if (idx->ckpts)
+		xfree(idx->ckpts);
+	xfree(idx);
+	o->idx = NULL;
 }
 
 /*
@@ -183,7 +540,7 @@ seqev_avail(struct seqev *pos)
 /*
  * insert an event (stored in an already allocated seqev structure)
  * just before the event of the given position (the delta field of the
- * given event is ignored)
+ * given event is ignored). The caller must call track_touch()
  */
 void
 seqev_ins(struct seqev *pos, struct seqev *se)
@@ -198,7 +555,8 @@ seqev_ins(struct seqev *pos, struct seqev *se)
 }
 
 /*
- * remove the event (but not blank space) on the given position
+ * remove the event (but not blank space) on the given position. The
+ * caller must call track_touch()
  */
 void
 seqev_rm(struct seqev *pos)
@@ -231,6 +589,23 @@ track_numev(struct track *o)
 	return n;
 }
 
+/*
+ * return the number of bytes of the chunks owned by the track
+ */
+unsigned
+track_memsize(struct track *o)
+{
+	struct seqev_chunk *c;
+	unsigned n;
+
+	n = 0;
+	for (c = o->chunks; c != NULL; c = c->next)
+		n++;
+	for (c = o->full; c != NULL; c = c->next)
+		n++;
+	return n * SEQEV_CHUNKSIZE;
+}
+
 /*
  * return the number of ticks in the track
  * ie its length (eot included, of course)
@@ -256,6 +631,7 @@ track_clear(struct track *o)
 {
 	struct seqev *i, *inext;
 
+	track_touch(o);
 	for (i = o->first;  i != &o->eot;  i = inext) {
 		inext = i->next;
 		seqev_del(i);
@@ -274,6 +650,7 @@ track_setchan(struct track *src, unsigned dev, unsigned ch)
 {
 	struct seqev *i;
 
+	track_touch(src);
 	for (i = src->first; i != NULL; i = i->next) {
 		if (EV_ISVOICE(&i->ev)) {
 			i->ev.dev = dev;
@@ -19,28 +19,97 @@
 
 #include "ev.h"
 
+struct state;
+
 struct seqev {
 	unsigned delta;
 	struct ev ev;
 	struct seqev *next, **prev;
 };
 
+/*
+ * events are allocated from chunks of contiguous memory, owned by
+ * tracks. The chunk size must be a power of two
+ */
+#define SEQEV_CHUNKSIZE	8192
+
+struct seqev_chunk;
+
+/*
+ * seek index: the state of a seqptr at every multiple of
+ * TRACK_IDXTICS tics, so seqptr_locate() doesn't need to read the
+ * track from the beginning. It's built on demand and dropped by
+ * track_touch() whenever the track is modified
+ */
+#define TRACK_IDXTICS	1024
+
+struct track_ckpt {
+	struct seqev *pos;		/* seqptr->pos */
+	unsigned delta;			/* seqptr->delta */
+	unsigned nstates;		/* number of states */
+	struct state *states;		/* copy of the statelist */
+};
+
+struct track_idx {
+	unsigned n;			/* number of checkpoints */
+	unsigned size;			/* allocated checkpoints */
+	struct track_ckpt *ckpts;	/* i-th is at (i + 1) * TRACK_IDXTICS */
+};
+
+/*
+ * tempo map: the tempo and the time signature at each tic they
+ * change, as found by reading the meta-events of the track. Between
+ * two entries, measures start every 'mlen' tics from 'mtic'. It's
+ * built on demand and dropped by track_touch()
+ */
+struct track_tment {
+	unsigned tic;			/* absolute tic */
+	unsigned meas;			/* first measure at or after tic */
+	unsigned mtic;			/* absolute tic of the above measure */
+	unsigned mlen;			/* tics per measure from mtic */
+	unsigned bpm, tpb;		/* time signature */
+	unsigned long usec24;		/* tempo */
+	unsigned long long time;	/* time at tic, in 24-th of us */
+};
+
+struct track_tmap {
+	unsigned n;			/* number of entries */
+	struct track_tment *ents;	/* entries, sorted by tic */
+};
+
 struct track {
 	struct seqev eot;		/* end-of-track event */
 	struct seqev *first;		/* head of the event list */
+	struct track_idx *idx;		/* seek index, or NULL */
+	struct track_tmap *tmap;	/* tempo map, or NULL */
+	struct seqev_chunk *chunks;	/* chunks with free events */
+	struct seqev_chunk *full;	/* chunks without free events */
+	struct track_data *undo;	/* undo data being saved, or NULL */
 };
 
+/*
+ * undo data of a track: a list of hunks, each one replacing 'nins'
+ * events, found 'skip' events after the previous hunk, by the next
+ * 'nrm' saved events; other events keep their absolute position.
+ * While the track is being modified, the 'nrm' events starting at the
+ * 'pos'-th one, i.e. all events at or after 'tic', are saved
+ */
 struct track_data {
 	struct seqev_data {
 		unsigned delta;
 		struct ev ev;
 	} *evs;
-	unsigned int pos, nrm, nins;
+	struct track_hunk {
+		unsigned int skip, nrm, nins;
+	} *hunks;
+	unsigned int nhunks;
+	unsigned int pos, nrm, tic;
 };
-
 void	      seqev_pool_init(unsigned);
 void	      seqev_pool_done(void);
-struct seqev *seqev_new(void);
+void	      seqev_pool_refill(void);
+unsigned      seqev_poolsize(void);
+struct seqev *seqev_new(struct track *);
 void	      seqev_del(struct seqev *);
 void	      seqev_dump(struct seqev *);
 
@@ -48,12 +117,17 @@ void	      track_init(struct track *);
 void	      track_done(struct track *);
 void	      track_dump(struct track *);
 unsigned      track_numev(struct track *);
+unsigned      track_memsize(struct track *);
 unsigned      track_numtic(struct track *);
 void	      track_clear(struct track *);
 unsigned      track_isempty(struct track *);
 void	      track_chomp(struct track *);
 void	      track_shift(struct track *, unsigned);
 void	      track_swap(struct track *, struct track *);
+void	      track_touch(struct track *);
+void	      track_touchat(struct track *, unsigned);
+void	      track_idxfree(struct track *);
+void	      track_compact(struct track *);
 
 unsigned      seqev_avail(struct seqev *);
 void	      seqev_ins(struct seqev *, struct seqev *);
@@ -63,8 +137,11 @@ void	      track_setchan(struct track *, unsigned, unsigned);
 void	      track_chanmap(struct track *, char *);
 unsigned      track_evcnt(struct track *, unsigned);
 
-unsigned track_undosave(struct track *, struct track_data *);
+void track_undosave(struct track *, struct track_data *);
+void track_undotouch(struct track *, unsigned);
 unsigned track_undodiff(struct track *, struct track_data *);
 void track_undorestore(struct track *, struct track_data *);
 
+extern unsigned seqev_nchunks, seqev_used, seqev_maxused;
+
 #endif /* MIDISH_TRACK_H */
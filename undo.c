@@ -14,6 +14,9 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
 #include "utils.h"
 #include "mididev.h"
 #include "mux.h"
@@ -28,6 +31,274 @@
 #include "norm.h"
 #include "undo.h"
 
+/*
+ * when undo data exceeds UNDO_MAXSIZE, the oldest track records are
+ * encoded and moved to the journal, a temporary file used as a
+ * stack. Each record is stored as its length followed by its hunks
+ * and its events, all numbers being stored as variable length
+ * integers. Encoded records are queued and written to the journal by
+ * undo_flush(), a few kilobytes at a time, so large amounts of data
+ * don't stall the main loop. As writing may block, it's not called
+ * while the song is running; records stay queued in memory instead.
+ */
+FILE *undo_jfile;			/* the journal, if any */
+int undo_jfailed;			/* journal couldn't be created */
+long undo_jend;				/* bytes used in the journal */
+unsigned undo_jcount;			/* records in the journal */
+unsigned undo_jdone;			/* bytes of the first record written */
+struct undo *undo_jqueue;		/* records to write */
+struct undo **undo_jtail = &undo_jqueue;
+
+#define UNDO_VARMAX	5		/* max size of an encoded number */
+
+/*
+ * store a variable length number, return the next position
+ */
+unsigned char *
+undo_putvar(unsigned char *p, unsigned val)
+{
+	while (val >= 0x80) {
+		*p++ = val | 0x80;
+		val >>= 7;
+	}
+	*p++ = val;
+	return p;
+}
+
+/*
+ * load a variable length number, return the next position
+ */
+unsigned char *
+undo_getvar(unsigned char *p, unsigned *rval)
+{
+	unsigned val = 0, shift = 0;
+
+	while (*p & 0x80) {
+		val |= (*p++ & 0x7f) << shift;
+		shift += 7;
+	}
+	*rval = val | (*p++ << shift);
+	return p;
+}
+
+/*
+ * replace the events and hunks of the given record by their encoded
+ * form
+ */
+void
+undo_encode(struct undo *u)
+{
+	struct track_data *d = &u->u.track.data;
+	struct seqev_data *e;
+	struct track_hunk *h;
+	struct ev last;
+	unsigned char *buf, *start, *p;
+	unsigned i, nevs, len, flags;
+
+	nevs = 0;
+	for (i = 0; i < d->nhunks; i++)
+		nevs += d->hunks[i].nrm;
+
+	/*
+	 * encode the data, leaving room for its length in front of it
+	 */
+	buf = xmalloc(UNDO_VARMAX * (3 + 3 * d->nhunks + 3 * nevs) + 4 * nevs,
+	    "undo_journal");
+	p = buf + 3 * UNDO_VARMAX;
+	p = undo_putvar(p, d->nhunks);
+	p = undo_putvar(p, nevs);
+	for (i = 0, h = d->hunks; i < d->nhunks; i++, h++) {
+		p = undo_putvar(p, h->skip);
+		p = undo_putvar(p, h->nrm);
+		p = undo_putvar(p, h->nins);
+	}
+	last.cmd = last.dev = last.ch = 0;
+	for (i = 0, e = d->evs; i < nevs; i++, e++) {
+		flags = 0;
+		if (e->ev.cmd != last.cmd)
+			flags |= 1;
+		if (e->ev.dev != last.dev)
+			flags |= 2;
+		if (e->ev.ch != last.ch)
+			flags |= 4;
+		*p++ = flags;
+		p = undo_putvar(p, e->delta);
+		if (flags & 1)
+			*p++ = e->ev.cmd;
+		if (flags & 2)
+			*p++ = e->ev.dev;
+		if (flags & 4)
+			*p++ = e->ev.ch;
+		p = undo_putvar(p, e->ev.v0);
+		p = undo_putvar(p, e->ev.v1);
+		last = e->ev;
+	}
+	len = p - (buf + 3 * UNDO_VARMAX);
+	start = buf + 3 * UNDO_VARMAX - (undo_putvar(buf, len) - buf);
+	undo_putvar(start, len);
+
+	u->u.track.jlen = p - start;
+	u->u.track.jbuf = xmalloc(u->u.track.jlen, "undo_journal");
+	memcpy(u->u.track.jbuf, start, u->u.track.jlen);
+	xfree(buf);
+	xfree(d->evs);
+	xfree(d->hunks);
+	d->evs = NULL;
+	d->hunks = NULL;
+}
+
+/*
+ * decode the given buffer into the events and hunks of the record
+ */
+void
+undo_decode(struct undo *u, unsigned char *p)
+{
+	struct track_data *d = &u->u.track.data;
+	struct seqev_data *e;
+	struct track_hunk *h;
+	struct ev last;
+	unsigned i, nevs, flags, val;
+
+	p = undo_getvar(p, &val);
+	p = undo_getvar(p, &d->nhunks);
+	p = undo_getvar(p, &nevs);
+	d->hunks = xmalloc(d->nhunks * sizeof(struct track_hunk),
+	    "track_hunk");
+	for (i = 0, h = d->hunks; i < d->nhunks; i++, h++) {
+		p = undo_getvar(p, &h->skip);
+		p = undo_getvar(p, &h->nrm);
+		p = undo_getvar(p, &h->nins);
+	}
+	d->evs = xmalloc(nevs * sizeof(struct seqev_data), "track_diff");
+	last.cmd = last.dev = last.ch = 0;
+	for (i = 0, e = d->evs; i < nevs; i++, e++) {
+		flags = *p++;
+		p = undo_getvar(p, &e->delta);
+		e->ev.cmd = (flags & 1) ? *p++ : last.cmd;
+		e->ev.dev = (flags & 2) ? *p++ : last.dev;
+		e->ev.ch = (flags & 4) ? *p++ : last.ch;
+		p = undo_getvar(p, &e->ev.v0);
+		p = undo_getvar(p, &e->ev.v1);
+		last = e->ev;
+	}
+}
+
+/*
+ * create the journal if not done yet, return 0 if there's none or if
+ * it couldn't be written
+ */
+int
+undo_jopen(void)
+{
+	if (undo_jfile == NULL && !undo_jfailed) {
+		undo_jfile = tmpfile();
+		if (undo_jfile == NULL) {
+			log_perror("undo: couldn't create journal");
+			undo_jfailed = 1;
+		}
+	}
+	return undo_jfile != NULL && !undo_jfailed;
+}
+
+/*
+ * remove the given record from the queue of records to write
+ */
+void
+undo_unqueue(struct undo *u)
+{
+	struct undo **pu;
+
+	if (u == undo_jqueue)
+		undo_jdone = 0;
+	for (pu = &undo_jqueue; *pu != u; pu = &(*pu)->u.track.jnext)
+		;
+	*pu = u->u.track.jnext;
+	if (undo_jtail == &u->u.track.jnext)
+		undo_jtail = pu;
+}
+
+/*
+ * forget the given record stored in the journal, and reclaim its
+ * space if it's at the end
+ */
+void
+undo_jdrop(struct undo *u)
+{
+	undo_jcount--;
+	if (undo_jcount == 0)
+		undo_jend = 0;
+	else if (u->u.track.joffs + u->u.track.jlen == undo_jend)
+		undo_jend = u->u.track.joffs;
+	else
+		return;
+	/* restart writing the first queued record at the new end */
+	undo_jdone = 0;
+}
+
+/*
+ * load back the data of the given record, either from its
+ * buffer or from the journal
+ */
+void
+undo_load(struct undo *u)
+{
+	unsigned char *buf;
+
+	if (u->u.track.jbuf != NULL) {
+		undo_unqueue(u);
+		buf = u->u.track.jbuf;
+		u->u.track.jbuf = NULL;
+	} else {
+		buf = xmalloc(u->u.track.jlen, "undo_journal");
+		if (fseek(undo_jfile, u->u.track.joffs, SEEK_SET) < 0 ||
+		    fread(buf, 1, u->u.track.jlen, undo_jfile) !=
+		    u->u.track.jlen) {
+			log_puts("undo_load: couldn't read journal\n");
+			panic();
+		}
+		undo_jdrop(u);
+		u->u.track.joffs = -1;
+	}
+	undo_decode(u, buf);
+	xfree(buf);
+}
+
+/*
+ * write queued records to the journal, at most UNDO_FLUSHSIZE bytes
+ * per call
+ */
+void
+undo_flush(void)
+{
+	struct undo *u;
+	unsigned n, avail = UNDO_FLUSHSIZE;
+
+	if (undo_jfailed)
+		return;
+	while ((u = undo_jqueue) != NULL && avail > 0) {
+		n = u->u.track.jlen - undo_jdone;
+		if (n > avail)
+			n = avail;
+		if (fseek(undo_jfile, undo_jend + undo_jdone, SEEK_SET) < 0 ||
+		    fwrite(u->u.track.jbuf + undo_jdone, 1, n, undo_jfile) !=
+		    n) {
+			/* keep queued records in memory */
+			log_perror("undo: couldn't write journal");
+			undo_jfailed = 1;
+			return;
+		}
+		undo_jdone += n;
+		avail -= n;
+		if (undo_jdone == u->u.track.jlen) {
+			undo_unqueue(u);
+			u->u.track.joffs = undo_jend;
+			undo_jend += u->u.track.jlen;
+			undo_jcount++;
+			xfree(u->u.track.jbuf);
+			u->u.track.jbuf = NULL;
+		}
+	}
+}
 
 struct undo *
 undo_new(struct song *s, int type, char *func, char *name)
@@ -56,6 +327,8 @@ undo_pop(struct song *s)
 		if (u == NULL)
 			return;
 		s->undo = u->next;
+		if (u == s->undo_jlast)
+			s->undo_jlast = s->undo;
 		if (u->func) {
 			log_puts("undo:");
 			log_puts(" ");
@@ -78,6 +351,8 @@ undo_pop(struct song *s)
 			*u->u.uint.ptr = u->u.uint.val;
 			break;
 		case UNDO_TRACK:
+			if (u->u.track.jbuf != NULL || u->u.track.joffs >= 0)
+				undo_load(u);
 			track_undorestore(u->u.track.track, &u->u.track.data);
 			break;
 		case UNDO_TDEL:
@@ -91,6 +366,8 @@ undo_pop(struct song *s)
 		case UNDO_FILT:
 			filt_reset(u->u.filt.filt);
 			*u->u.filt.filt = u->u.filt.data;
+			if (mux_isopen)
+				filt_compile(u->u.filt.filt);
 			break;
 		case UNDO_FDEL:
 			name_add(&s->filtlist, &u->u.fdel.filt->name);
@@ -166,6 +443,8 @@ undo_clear(struct song *s, struct undo **pos)
 
 	while ((u = *pos) != NULL) {
 		*pos = u->next;
+		if (u == s->undo_jlast)
+			s->undo_jlast = NULL;
 		switch (u->type) {
 		case UNDO_EMPTY:
 			break;
@@ -175,7 +454,15 @@ undo_clear(struct song *s, struct undo **pos)
 		case UNDO_UINT:
 			break;
 		case UNDO_TRACK:
-			xfree(u->u.track.data.evs);
+			if (u->u.track.jbuf != NULL) {
+				undo_unqueue(u);
+				xfree(u->u.track.jbuf);
+			} else if (u->u.track.joffs >= 0) {
+				undo_jdrop(u);
+			} else {
+				xfree(u->u.track.data.evs);
+				xfree(u->u.track.data.hunks);
+			}
 			break;
 		case UNDO_TDEL:
 			track_done(&u->u.tdel.trk->track);
@@ -232,39 +519,94 @@ undo_clear(struct song *s, struct undo **pos)
 	}
 }
 
+/*
+ * the journal couldn't be written, so queued records never will: free
+ * them, as well as older records, which can't be undone anymore
+ */
 void
-undo_push(struct song *s, struct undo *u)
+undo_jabort(struct song *s)
 {
 	struct undo **pu;
+
+	for (pu = &s->undo; *pu != NULL; pu = &(*pu)->next) {
+		if ((*pu)->type == UNDO_TRACK && (*pu)->u.track.jbuf != NULL) {
+			undo_clear(s, pu);
+			break;
+		}
+	}
+}
+
+/*
+ * move old track entries exceeding memory usage limit to the journal.
+ * Other entries (filters, sysex messages) are small, so they are kept
+ * in memory. If there's no journal, entries are freed with all older
+ * entries instead. Entries older than s->undo_jlast are already in
+ * the journal (or are kept in memory), so they are not examined
+ */
+void
+undo_trim(struct song *s)
+{
+	struct undo *u, **pu, **cut, **jpos;
 	size_t size;
 
-	u->next = s->undo;
-	s->undo = u;
-	s->undo_size += u->size;
-#ifdef SONG_DEBUG
-	log_puts("undo: ");
-	log_puts(u->func);
-	log_puts(", size -> ");
-	log_puti(s->undo_size);
-	log_puts("\n");
-#endif
+	if (undo_jfailed && undo_jqueue != NULL)
+		undo_jabort(s);
+	if (s->undo_size <= UNDO_MAXSIZE)
+		return;
 
 	/*
-	 * free old entries exceeding memory usage limit
+	 * skip the newest entries that fit in the limit
 	 */
 	size = 0;
-	pu = &s->undo;
-	while (1) {
-		u = *pu;
-		if (u == NULL)
+	for (cut = &s->undo; ; cut = &u->next) {
+		u = *cut;
+		if (u == NULL || u == s->undo_jlast)
 			return;
 		size += u->size;
 		if (size > UNDO_MAXSIZE)
 			break;
-		pu = &u->next;
 	}
 
-	undo_clear(s, pu);
+	/*
+	 * entries are queued in reverse order, so the oldest ones
+	 * are written first
+	 */
+	jpos = undo_jtail;
+	for (pu = cut; (u = *pu) != NULL && u != s->undo_jlast;
+	     pu = &u->next) {
+		if (u->size == 0)
+			continue;
+		if (!undo_jopen()) {
+			undo_clear(s, pu);
+			break;
+		}
+		if (u->type != UNDO_TRACK)
+			continue;
+		undo_encode(u);
+		s->undo_size -= u->size;
+		u->size = 0;
+		u->u.track.jnext = *jpos;
+		*jpos = u;
+		if (u->u.track.jnext == NULL)
+			undo_jtail = &u->u.track.jnext;
+	}
+	s->undo_jlast = *cut;
+}
+
+void
+undo_push(struct song *s, struct undo *u)
+{
+	u->next = s->undo;
+	s->undo = u;
+	s->undo_size += u->size;
+#ifdef SONG_DEBUG
+	log_puts("undo: ");
+	log_puts(u->func);
+	log_puts(", size -> ");
+	log_puti(s->undo_size);
+	log_puts("\n");
+#endif
+	undo_trim(s);
 }
 
 void
@@ -320,81 +662,267 @@ undo_scale(struct song *s, char *func, char *tag,
 	undo_push(s, u);
 }
 
-unsigned
+/*
+ * start saving undo data of the given track: events are saved by
+ * track_undotouch() only when they are about to be modified
+ */
+void
 track_undosave(struct track *t, struct track_data *u)
 {
-	struct seqev *i;
-	struct seqev_data *e;
-	unsigned size;
+	u->evs = NULL;
+	u->hunks = NULL;
+	u->nhunks = 0;
+	u->pos = 0;
+	u->nrm = 0;
+	u->tic = 0;
+	t->undo = u;
+}
 
-	u->nins = track_numev(t);
-	size = sizeof(struct seqev_data) * u->nins;
-	u->evs = xmalloc(size, "track_data");
-	e = u->evs;
-	for (i = t->first; i != NULL; i = i->next) {
+/*
+ * called before events at or after the given tic are modified: save
+ * the ones that are not saved yet. Events before 'tic' are never
+ * modified, so they are the same as in the original track
+ */
+void
+track_undotouch(struct track *t, unsigned tic)
+{
+	struct track_data *u = t->undo;
+	struct seqev *first, *i;
+	struct seqev_data *evs, *e;
+	unsigned k, n, pos, ntic;
+
+	if (u->evs != NULL && tic >= u->tic)
+		return;
+
+	/* find the first event at or after 'tic' */
+	pos = 0;
+	ntic = 0;
+	for (first = t->first; ; first = first->next) {
+		ntic += first->delta;
+		if (ntic >= tic || first->ev.cmd == EV_NULL)
+			break;
+		pos++;
+	}
+
+	/* count events between it and the saved ones */
+	if (u->evs == NULL) {
+		n = 0;
+		for (i = first; i != NULL; i = i->next)
+			n++;
+	} else
+		n = u->pos - pos;
+
+	evs = xmalloc(sizeof(struct seqev_data) * (n + u->nrm), "track_data");
+	e = evs;
+	for (i = first, k = n; k > 0; i = i->next, k--) {
 		e->delta = i->delta;
 		e->ev = i->ev;
 		e++;
 	}
-	u->pos = 0;
-	u->nrm = 0;
-	return size;
+	if (u->evs != NULL) {
+		for (k = 0; k < u->nrm; k++)
+			*e++ = u->evs[k];
+		xfree(u->evs);
+	}
+	u->evs = evs;
+	u->pos = pos;
+	u->nrm += n;
+	u->tic = tic;
 }
 
-void
-track_diff(struct track_data *u1, struct track_data *u2,
-	unsigned *pos, unsigned *nrm, unsigned *nins)
+/*
+ * start a new hunk if there's none, and return it
+ */
+struct track_hunk *
+track_undohunk(struct track_data *u, struct track_hunk *h, unsigned *skip)
+{
+	if (h == NULL) {
+		h = &u->hunks[u->nhunks++];
+		h->skip = *skip;
+		h->nrm = 0;
+		h->nins = 0;
+		*skip = 0;
+	}
+	return h;
+}
+
+/*
+ * stop saving undo data of the given track, and keep only the saved
+ * events that differ from the current ones, as a list of hunks.
+ * Return the size of the undo data
+ */
+unsigned
+track_undodiff(struct track *t, struct track_data *u)
 {
-	unsigned start, end1, end2;
+	struct seqev *i, *se;
+	struct seqev_data *old, *evs;
+	struct track_hunk *h, *hunks;
+	unsigned k, n, start, end1, end2, skip, told, tnew, to, tn, nold, nnew;
+
+	t->undo = NULL;
+	if (u->evs == NULL) {
+		/* nothing was modified */
+		u->evs = xmalloc(0, "track_diff");
+		u->hunks = xmalloc(0, "track_hunk");
+		return 0;
+	}
+	old = u->evs;
 
+	/* go to the first saved event and skip the common prefix */
+	se = t->first;
+	for (k = u->pos; k > 0; k--)
+		se = se->next;
 	start = 0;
-	while (1) {
-		if (start == u1->nins || start == u2->nins)
-			break;
-		if (u1->evs[start].delta != u2->evs[start].delta)
+	while (start < u->nrm) {
+		if (old[start].delta != se->delta)
 			break;
-		if (!ev_eq(&u1->evs[start].ev, &u2->evs[start].ev))
+		if (!ev_eq(&old[start].ev, &se->ev))
 			break;
+		se = se->next;
 		start++;
 	}
 
-	end1 = u1->nins;
-	end2 = u2->nins;
-	while (1) {
-		if (end1 == start || end2 == start)
-			break;
-		if (u1->evs[end1 - 1].delta != u2->evs[end2 - 1].delta)
-			break;
-		if (!ev_eq(&u1->evs[end1 - 1].ev, &u2->evs[end2 - 1].ev))
+	/*
+	 * count the remaining events, and skip the common suffix,
+	 * i.e. events with the same absolute position
+	 */
+	end2 = 0;
+	tn = 0;
+	for (i = se; i != NULL; i = i->next) {
+		tn += i->delta;
+		end2++;
+	}
+	to = 0;
+	for (k = start; k < u->nrm; k++)
+		to += old[k].delta;
+	end1 = u->nrm;
+	i = &t->eot;
+	while (end1 > start && end2 > 0) {
+		if (to != tn || !ev_eq(&old[end1 - 1].ev, &i->ev))
 			break;
+		to -= old[end1 - 1].delta;
+		tn -= i->delta;
 		end1--;
 		end2--;
+		if (end2 > 0) {
+			i = (struct seqev *)((char *)i->prev -
+			    offsetof(struct seqev, next));
+		}
 	}
-	*pos = start;
-	*nrm = end1 - start;
-	*nins = end2 - start;
-}
 
-unsigned
-track_undodiff(struct track *t, struct track_data *orig)
-{
-	struct track_data mod;
-	unsigned int i, pos, nrm, nins;
-	struct seqev_data *evs;
-
-	track_undosave(t, &mod);
-	track_diff(orig, &mod, &pos, &nrm, &nins);
+	/*
+	 * events are sorted by tic, so walk both lists in parallel,
+	 * matching events of the same tic; unmatched events form the
+	 * hunks. The end-of-track is always part of the last hunk
+	 */
+	evs = xmalloc(sizeof(struct seqev_data) * (end1 - start),
+	    "track_diff");
+	u->hunks = xmalloc(sizeof(struct track_hunk) *
+	    (end1 - start + end2), "track_hunk");
+	u->nhunks = 0;
+	h = NULL;
+	n = 0;
+	skip = u->pos + start;
+	told = tnew = 0;
+	while (start < end1 && end2 > 0) {
+		if (old[start].ev.cmd == EV_NULL || se->ev.cmd == EV_NULL)
+			break;
+		to = told + old[start].delta;
+		tn = tnew + se->delta;
+		if (to == tn) {
+			if (ev_eq(&old[start].ev, &se->ev)) {
+				/* common event */
+				h = NULL;
+				skip++;
+				told = to;
+				tnew = tn;
+				start++;
+				se = se->next;
+				end2--;
+				continue;
+			}
 
-	evs = xmalloc(sizeof(struct seqev_data) * nrm, "track_diff");
-	for (i = 0; i < nrm; i++)
-		evs[i] = orig->evs[pos + i];
-	xfree(mod.evs);
-	xfree(orig->evs);
-	orig->evs = evs;
-	orig->nins = nins;
-	orig->nrm = nrm;
-	orig->pos = pos;
-	return sizeof(struct seqev_data) * nrm;
+			/*
+			 * look for each event in the next events of the
+			 * same tic of the other list, and skip the
+			 * fewest events to match one of them
+			 */
+			i = se->next;
+			for (nnew = 1; nnew < end2; nnew++) {
+				if (i->delta != 0 || i->ev.cmd == EV_NULL) {
+					nnew = end2;
+					break;
+				}
+				if (ev_eq(&old[start].ev, &i->ev))
+					break;
+				i = i->next;
+			}
+			for (nold = 1; start + nold < end1; nold++) {
+				if (old[start + nold].delta != 0 ||
+				    old[start + nold].ev.cmd == EV_NULL) {
+					nold = end1 - start;
+					break;
+				}
+				if (ev_eq(&old[start + nold].ev, &se->ev))
+					break;
+			}
+			if (start + nold < end1 &&
+			    (nnew == end2 || nold <= nnew)) {
+				/* events before it were removed */
+				h = track_undohunk(u, h, &skip);
+				h->nrm += nold;
+				for (k = 0; k < nold; k++)
+					evs[n++] = old[start++];
+				told = to;
+				continue;
+			}
+			if (nnew < end2) {
+				/* events before it were inserted */
+				h = track_undohunk(u, h, &skip);
+				h->nins += nnew;
+				tnew = tn;
+				se = i;
+				end2 -= nnew;
+				continue;
+			}
+		}
+		if (to <= tn) {
+			/* removed event */
+			h = track_undohunk(u, h, &skip);
+			h->nrm++;
+			evs[n++] = old[start];
+			told = to;
+			start++;
+		} else {
+			/* inserted event */
+			h = track_undohunk(u, h, &skip);
+			h->nins++;
+			tnew = tn;
+			se = se->next;
+			end2--;
+		}
+	}
+	if (start < end1 || end2 > 0) {
+		h = track_undohunk(u, h, &skip);
+		h->nrm += end1 - start;
+		h->nins += end2;
+		while (start < end1)
+			evs[n++] = old[start++];
+	}
+	xfree(old);
+
+	/* shrink arrays to their actual size */
+	u->evs = xmalloc(sizeof(struct seqev_data) * n, "track_diff");
+	for (k = 0; k < n; k++)
+		u->evs[k] = evs[k];
+	xfree(evs);
+	hunks = xmalloc(sizeof(struct track_hunk) * u->nhunks, "track_hunk");
+	for (k = 0; k < u->nhunks; k++)
+		hunks[k] = u->hunks[k];
+	xfree(u->hunks);
+	u->hunks = hunks;
+	return sizeof(struct seqev_data) * n +
+	    sizeof(struct track_hunk) * u->nhunks;
 }
 
 void
@@ -403,54 +931,62 @@ track_undorestore(struct track *t, struct track_data *u)
 	unsigned n;
 	struct seqev *pos, *se;
 	struct seqev_data *e;
+	struct track_hunk *h;
+
+	track_touch(t);
 
-	/* go to pos */
 	pos = t->first;
-	for (n = u->pos; n > 0; n--)
-		pos = pos->next;
-
-	/* remove events that were inserted */
-	for (n = u->nins; n > 0; n--) {
-		if (pos->ev.cmd == EV_NULL) {
-			if (n != 1) {
-				log_puts("can't remove eot event\n");
-				panic();
+	e = u->evs;
+	for (h = u->hunks; h != u->hunks + u->nhunks; h++) {
+
+		/* skip common events */
+		for (n = h->skip; n > 0; n--)
+			pos = pos->next;
+
+		/* remove events that were inserted */
+		for (n = h->nins; n > 0; n--) {
+			if (pos->ev.cmd == EV_NULL) {
+				if (n != 1) {
+					log_puts("can't remove eot event\n");
+					panic();
+				}
+				break;
 			}
-			pos->delta = 0;
-			break;
+			se = pos;
+			pos = se->next;
+
+			/* remove seqev, but not blank space */
+			pos->delta += se->delta;
+			*se->prev = pos;
+			pos->prev = se->prev;
+			seqev_del(se);
 		}
-		se = pos;
-		pos = se->next;
 
-		/* remove seqev */
-		*se->prev = pos;
-		pos->prev = se->prev;
-		seqev_del(se);
-	}
-
-	/* insert events that were removed */
-	e = u->evs;
-	for (n = u->nrm; n > 0; n--) {
-		if (e->ev.cmd == EV_NULL) {
-			if (n != 1) {
-				log_puts("can't insert eot event\n");
-				panic();
+		/* insert events that were removed */
+		for (n = h->nrm; n > 0; n--) {
+			if (e->ev.cmd == EV_NULL) {
+				if (n != 1) {
+					log_puts("can't insert eot event\n");
+					panic();
+				}
+				t->eot.delta = e->delta;
+				break;
 			}
-			t->eot.delta = e->delta;
-			break;
+			se = seqev_new(t);
+			se->ev = e->ev;
+			se->delta = e->delta;
+			e++;
+
+			/* insert seqev, at the same absolute position */
+			pos->delta -= se->delta;
+			se->next = pos;
+			se->prev = pos->prev;
+			*(se->prev) = se;
+			pos->prev = &se->next;
 		}
-		se = seqev_new();
-		se->ev = e->ev;
-		se->delta = e->delta;
-		e++;
-
-		/* insert seqev */
-		se->next = pos;
-		se->prev = pos->prev;
-		*(se->prev) = se;
-		pos->prev = &se->next;
 	}
 	xfree(u->evs);
+	xfree(u->hunks);
 }
 
 void
@@ -460,7 +996,9 @@ undo_track_save(struct song *s, struct track *t, char *func, char *name)
 
 	u = undo_new(s, UNDO_TRACK, func, name);
 	u->u.track.track = t;
-	u->size = track_undosave(t, &u->u.track.data);
+	u->u.track.jbuf = NULL;
+	u->u.track.joffs = -1;
+	track_undosave(t, &u->u.track.data);
 	undo_push(s, u);
 }
 
@@ -477,6 +1015,12 @@ undo_track_diff(struct song *s)
 	size = track_undodiff(u->u.track.track, &u->u.track.data);
 	s->undo_size += size - u->size;
 	u->size = size;
+	undo_trim(s);
+
+	/*
+	 * the edit may have removed many events from the track
+	 */
+	track_compact(u->u.track.track);
 }
 
 void
@@ -528,6 +1072,7 @@ filtnode_dup(struct filtnode **dloc, struct filtnode **sloc)
 	s = *sloc;
 	while (s != NULL) {
 		d = filtnode_new(&s->es, dloc);
+		d->u = s->u;
 		filtnode_dup(&d->dstlist, &s->dstlist);
 		dloc = &d->next;
 		s = s->next;
@@ -60,6 +60,10 @@ struct undo {
 		struct undo_track {
 			struct track *track;
 			struct track_data data;
+			struct undo *jnext;	/* next record to write */
+			unsigned char *jbuf;	/* data not written yet */
+			unsigned jlen;		/* size of encoded data */
+			long joffs;		/* offset in the journal */
 		} track;
 		struct undo_tdel {
 			struct songtrk *trk;
@@ -101,6 +105,8 @@ void undo_setstr(struct song *, char *, char **, char *);
 void undo_setuint(struct song *, char *, char *, unsigned int *, unsigned int);
 void undo_scale(struct song *, char *, char *, unsigned int, unsigned int);
 
+void undo_flush(void);
+
 void undo_track_save(struct song *, struct track *, char *, char *);
 void undo_track_diff(struct song *);
 void undo_tdel_do(struct song *, struct songtrk *, char *);
@@ -119,4 +125,6 @@ void undo_xrm_do(struct song *, char *, struct songsx *, unsigned int);
 void undo_xdel_do(struct song *, char *, struct songsx *);
 struct songsx *undo_xnew_do(struct song *, char *, char *);
 
+extern long undo_jend;
+
 #endif /* MIDISH_UNDO_H */
@@ -1012,6 +1012,8 @@ user_mainloop(void)
 	exec_newbuiltin(exec, "reset", blt_reset, NULL);
 	exec_newbuiltin(exec, "export", blt_export,
 			name_newarg("filename", NULL));
+	exec_newbuiltin(exec, "render", blt_render,
+			name_newarg("filename", NULL));
 	exec_newbuiltin(exec, "import", blt_import,
 			name_newarg("filename", NULL));
 	exec_newbuiltin(exec, "i", blt_idle, NULL);
@@ -1054,6 +1056,11 @@ user_mainloop(void)
 			name_newarg("mode", NULL));
 	exec_newbuiltin(exec, "tapev", blt_tapev,
 			name_newarg("evspec", NULL));
+	exec_newbuiltin(exec, "thin", blt_thin,
+			name_newarg("evspec",
+			name_newarg("msec",
+			name_newarg("delta",
+			name_newarg("smooth", NULL)))));
 	exec_newbuiltin(exec, "u", blt_undo, NULL);
 	exec_newbuiltin(exec, "ul", blt_undolist, NULL);
 	exec_newbuiltin(exec, "tlist", blt_tlist, NULL);
@@ -1215,6 +1222,22 @@ user_mainloop(void)
 	exec_newbuiltin(exec, "dclkrate", blt_dclkrate,
 			name_newarg("devnum",
 			name_newarg("tics_per_unit", NULL)));
+	exec_newbuiltin(exec, "tickless", blt_tickless,
+			name_newarg("flag", NULL));
+	exec_newbuiltin(exec, "dothread", blt_dothread,
+			name_newarg("devnum",
+			name_newarg("flag", NULL)));
+	exec_newbuiltin(exec, "dinject", blt_dinject,
+			name_newarg("devnum",
+			name_newarg("data", NULL)));
+	exec_newbuiltin(exec, "lookahead", blt_lookahead,
+			name_newarg("msec", NULL));
+	exec_newbuiltin(exec, "lowlat", blt_lowlat,
+			name_newarg("flag", NULL));
+	exec_newbuiltin(exec, "rtstat", blt_rtstat, NULL);
+	exec_newbuiltin(exec, "meminfo", blt_meminfo, NULL);
+	exec_newbuiltin(exec, "poolshrink", blt_poolshrink,
+			name_newarg("flag", NULL));
 	exec_newbuiltin(exec, "dinfo", blt_dinfo,
 			name_newarg("devnum", NULL));
 	exec_newbuiltin(exec, "dixctl", blt_dixctl,
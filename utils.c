@@ -41,6 +41,24 @@
 		log_buf[log_used++] = (c);	\
 } while (0)
 
+/*
+ * header of blocks allocated with xmalloc()
+ */
+union memhdr {
+	struct {
+		struct memtag *tag;	/* what the block is used for */
+		size_t size;		/* size requested by the caller */
+	} s;
+	long double align;		/* so the block is aligned */
+};
+
+struct memtag mem_tags[MEM_NTAGS];	/* per-tag xmalloc() usage */
+unsigned mem_ntags = 0;			/* tags used in mem_tags */
+struct memptr mem_hash[MEM_NHASH];	/* tag pointer to mem_tags entry */
+unsigned mem_nhash = 0;			/* used entries in mem_hash */
+size_t mem_used = 0;			/* bytes allocated by xmalloc() */
+size_t mem_maxused = 0;			/* max of the above */
+
 char log_buf[LOG_BUFSZ];	/* buffer where traces are stored */
 unsigned int log_used = 0;	/* bytes used in the buffer */
 unsigned int log_sync = 1;	/* if true, flush after each '\n' */
@@ -171,24 +189,99 @@ panic(void)
 	_exit(1);
 }
 
+/*
+ * return the accounting structure of the given xmalloc() tag, by
+ * name. Identical tags passed by different call sites may be
+ * different pointers, so pointers can't be used
+ */
+struct memtag *
+mem_lookupname(char *tag)
+{
+	struct memtag *t;
+
+	for (t = mem_tags; t < mem_tags + mem_ntags; t++) {
+		if (strcmp(t->tag, tag) == 0)
+			return t;
+	}
+	/*
+	 * if there are too many tags, use the last one for all
+	 * remaining tags
+	 */
+	if (mem_ntags == MEM_NTAGS)
+		return t - 1;
+	if (mem_ntags == MEM_NTAGS - 1)
+		tag = "other";
+	mem_ntags++;
+	t->tag = tag;
+	t->used = t->maxused = 0;
+	t->nalloc = 0;
+	return t;
+}
+
+/*
+ * return the accounting structure of the given xmalloc() tag. Tags
+ * are string literals, so the result is cached in a hash table
+ * indexed by the tag pointer, and the name is only compared the
+ * first time a pointer is seen
+ */
+struct memtag *
+mem_lookup(char *tag)
+{
+	struct memptr *p;
+	struct memtag *t;
+	unsigned h;
+
+	h = ((unsigned long)tag >> 3) * 2654435761U;
+	for (;;) {
+		p = &mem_hash[h & (MEM_NHASH - 1)];
+		if (p->ptr == tag)
+			return p->tag;
+		if (p->ptr == NULL)
+			break;
+		h++;
+	}
+	t = mem_lookupname(tag);
+
+	/*
+	 * keep the table at most half full, so chains remain short
+	 */
+	if (mem_nhash < MEM_NHASH / 2) {
+		p->ptr = tag;
+		p->tag = t;
+		mem_nhash++;
+	}
+	return t;
+}
+
 /*
  * allocate 'size' bytes of memory (with size > 0). This functions never
  * fails (and never returns NULL), if there isn't enough memory then
- * abort the program.
+ * abort the program. Allocated bytes are accounted per tag.
  */
 void *
 xmalloc(size_t size, char *tag)
 {
-	void *p;
+	union memhdr *h;
+	struct memtag *t;
 
-	p = malloc(size);
-	if (p == NULL) {
+	h = malloc(sizeof(union memhdr) + size);
+	if (h == NULL) {
 		log_puts("failed to allocate ");
 		log_putx(size);
 		log_puts(" bytes\n");
 		panic();
 	}
-	return p;
+	t = mem_lookup(tag);
+	t->used += size;
+	if (t->maxused < t->used)
+		t->maxused = t->used;
+	t->nalloc++;
+	mem_used += size;
+	if (mem_maxused < mem_used)
+		mem_maxused = mem_used;
+	h->s.tag = t;
+	h->s.size = size;
+	return h + 1;
 }
 
 /*
@@ -197,13 +290,18 @@ xmalloc(size_t size, char *tag)
 void
 xfree(void *p)
 {
+	union memhdr *h;
+
 #ifdef DEBUG
 	if (p == NULL) {
 		log_puts("xfree with NULL arg\n");
 		panic();
 	}
 #endif
-	free(p);
+	h = (union memhdr *)p - 1;
+	h->s.tag->used -= h->s.size;
+	mem_used -= h->s.size;
+	free(h);
 }
 
 /*
@@ -23,6 +23,34 @@
 extern "C" {
 #endif
 
+/*
+ * max number of different xmalloc() tags
+ */
+#define MEM_NTAGS	64
+
+/*
+ * xmalloc() usage for a given tag
+ */
+struct memtag {
+	char *tag;
+	size_t used;		/* bytes currently allocated */
+	size_t maxused;		/* max of the above */
+	unsigned long nalloc;	/* number of calls to xmalloc() */
+};
+
+/*
+ * size of the hash table of tag pointers, must be a power of 2
+ */
+#define MEM_NHASH	256
+
+/*
+ * entry of the hash table of tag pointers
+ */
+struct memptr {
+	char *ptr;		/* tag, as passed to xmalloc() */
+	struct memtag *tag;	/* its accounting structure */
+};
+
 void log_putc(char *, size_t);
 void log_puts(char *);
 void log_putx(unsigned long);
@@ -42,5 +70,8 @@ void xfree(void *);
 #endif
 
 extern unsigned log_sync;
+extern struct memtag mem_tags[];
+extern unsigned mem_ntags;
+extern size_t mem_used, mem_maxused;
 
 #endif /* UTILS_H */